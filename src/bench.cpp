@@ -0,0 +1,1517 @@
+/**
+ * @file bench.cpp
+ * @author Edgar Jose Donoso Mansilla
+ * @course CS280
+ * @term Spring 2025
+ * @assignment# 3
+ *
+ * Benchmarks of the solver. Usage:
+ *   bench suite [hands]
+ *   bench regression [baseline] [node_ratio] [time_ratio]
+ *   bench baseline [baseline]
+ *   bench batch [hands] [threads]
+ *   bench dispatch [hands]
+ *   bench allocations [hands]
+ *   bench stats [hands]
+ *   bench trace [hands]
+ *   bench solvable [hands]
+ *   bench ordering [hands]
+ *   bench rules [hands]
+ *   bench jokers [hands]
+ *   bench subset [hands]
+ * The regression mode only compares node counts unless it is given a
+ * time_ratio, since the times of the baseline come from another machine.
+ * Without arguments all of them run with their default sizes. Every hand
+ * comes from a generator with a fixed seed, so every run solves the same work.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "rummikub.h"
+#include "rummikub_sweep.h"
+
+// The baseline checked in with the sources, the build points it at the source
+// tree so that the benchmark finds it from any directory
+#ifndef BENCH_BASELINE
+  #define BENCH_BASELINE "bench_baseline.csv"
+#endif
+
+namespace {
+  // Heap allocations made by any thread while counting is on
+  std::atomic<bool> counting{false};
+  std::atomic<size_t> allocations{0};
+} // namespace
+
+void *operator new(std::size_t size) {
+  if (counting.load(std::memory_order_relaxed)) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void *memory = std::malloc(size != 0 ? size : 1);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+// Not inlined: GCC takes the free() of an inlined delete for a mismatch with
+// the new that returned the memory
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+namespace {
+  /**
+   * @brief The generator of the driver, with the random engine passed in so
+   * that every run of the benchmark solves the same hands.
+   */
+  std::vector<Tile> GenerateRandomSolvable(
+      std::mt19937 &gen, int num_runs, int max_run_length, int num_groups) {
+    std::uniform_int_distribution<int> dis_group_denomination(0, 12);
+    std::uniform_int_distribution<int> dis_group_length(3, 4);
+    std::uniform_int_distribution<int> dis_run_color(0, 3);
+    std::uniform_int_distribution<int> dis_run_start(0, 10);
+    std::uniform_int_distribution<int> dis_rand(0, 10000000);
+
+    std::vector<Tile> tiles;
+
+    for (int i = 0; i < num_groups; ++i) {
+      int denomination = dis_group_denomination(gen);
+      int length = dis_group_length(gen);
+      int color_to_skip = length == 4 ? -1 : dis_rand(gen) % 4;
+      for (int color = 0; color < kColors; color++) {
+        if (color != color_to_skip) {
+          tiles.push_back({denomination, static_cast<Color>(color)});
+        }
+      }
+    }
+
+    for (int i = 0; i < num_runs; ++i) {
+      int start = dis_run_start(gen);
+      int last = std::min(13, start + max_run_length);
+      int end = start + 3 + dis_rand(gen) % (last + 1 - 3 - start);
+      Color col = static_cast<Color>(dis_run_color(gen));
+      for (int d = start; d < end; ++d) {
+        tiles.push_back({d, col});
+      }
+    }
+
+    std::shuffle(tiles.begin(), tiles.end(), gen);
+    return tiles;
+  }
+
+  /**
+   * @brief Check that a hand has no more copies of a tile than a RummiKub
+   * takes, the generator can stack more when it makes many sets.
+   *
+   * @param hand The hand to check.
+   * @param max_copies The copies of a tile allowed.
+   */
+  bool Fits(const std::vector<Tile> &hand, int max_copies = kMaxCopies) {
+    int copies[kDenominations][kColors] = {};
+    for (const Tile &tile: hand) {
+      if (++copies[tile.denomination][tile.color] > max_copies) return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief A solvable hand of an exact size, made of random runs of 3 to 5
+   * tiles and groups of 3 or 4.
+   *
+   * @param gen The random engine.
+   * @param size The amount of tiles.
+   * @param max_copies The copies of a tile the hand may have.
+   * @param denominations The sets use the denominations below this (5 to 13).
+   */
+  std::vector<Tile> GenerateSolvableOfSize(
+      std::mt19937 &gen, int size, int max_copies, int denominations) {
+    std::uniform_int_distribution<int> dis_set_size(3, 5);
+    std::uniform_int_distribution<int> dis_color(0, kColors - 1);
+    std::uniform_int_distribution<int> dis_coin(0, 1);
+
+    for (;;) {
+      std::vector<Tile> tiles;
+      for (int left = size; left > 0;) {
+        int set_size = dis_set_size(gen);
+        // A set must not leave 1 or 2 tiles, no set could take them
+        if (left - set_size < 3 && left != set_size) {
+          set_size = left <= 5 ? left : 3;
+        }
+        left -= set_size;
+
+        if (set_size == 5 || dis_coin(gen)) {
+          std::uniform_int_distribution<int> dis_start(
+              0, denominations - set_size);
+          int start = dis_start(gen);
+          Color color = static_cast<Color>(dis_color(gen));
+          for (int d = start; d < start + set_size; d++) {
+            tiles.push_back({d, color});
+          }
+        } else {
+          std::uniform_int_distribution<int> dis_denomination(
+              0, denominations - 1);
+          int denomination = dis_denomination(gen);
+          int color_to_skip = set_size == 4 ? -1 : dis_color(gen);
+          for (int color = 0; color < kColors; color++) {
+            if (color != color_to_skip) {
+              tiles.push_back({denomination, static_cast<Color>(color)});
+            }
+          }
+        }
+      }
+
+      if (Fits(tiles, max_copies)) {
+        std::shuffle(tiles.begin(), tiles.end(), gen);
+        return tiles;
+      }
+    }
+  }
+
+  /**
+   * @brief A hand of an exact size that cannot be played: a solvable hand with
+   * one of its tiles swapped for another, kept only if the swap broke it.
+   *
+   * @param gen The random engine.
+   * @param size The amount of tiles.
+   */
+  std::vector<Tile> GenerateUnsolvableOfSize(std::mt19937 &gen, int size) {
+    std::uniform_int_distribution<int> dis_tile(0, size - 1);
+    std::uniform_int_distribution<int> dis_denomination(0, kDenominations - 1);
+    std::uniform_int_distribution<int> dis_color(0, kColors - 1);
+
+    RummiKub checker(RummiKub::DynamicProgramming);
+    for (;;) {
+      std::vector<Tile> hand = GenerateSolvableOfSize(gen, size, 2, 13);
+      hand[static_cast<size_t>(dis_tile(gen))] =
+          Tile{dis_denomination(gen), static_cast<Color>(dis_color(gen))};
+      if (!Fits(hand, 2)) continue;
+
+      for (const Tile &tile: hand) checker.Add(tile);
+      checker.Solve();
+      if (checker.GetRunCount() + checker.GetGroupCount() == 0) return hand;
+    }
+  }
+
+  /**
+   * @brief Hands stored one after the other, in the layout SolveBatch takes.
+   */
+  struct HandBuffer {
+    std::vector<Tile> tiles;
+    std::vector<size_t> offsets{0};
+
+    size_t size() const { return offsets.size() - 1; }
+
+    void push_back(const std::vector<Tile> &hand) {
+      tiles.insert(tiles.end(), hand.begin(), hand.end());
+      offsets.push_back(tiles.size());
+    }
+  };
+
+  /**
+   * @brief Solve the workload of test3 (GenerateRandomSolvable(2, 4, 2)) with
+   * SolveBatch, doubling the threads up to the given amount.
+   */
+  void BenchBatch(size_t hand_count, unsigned max_threads) {
+    std::mt19937 gen(280);
+    HandBuffer hands;
+    for (size_t i = 0; i < hand_count; i++) {
+      hands.push_back(GenerateRandomSolvable(gen, 2, 4, 2));
+    }
+
+    std::unique_ptr<bool[]> solvable(new bool[hand_count]);
+
+    std::cout << "batch: " << hand_count << " hands of test3, "
+              << std::thread::hardware_concurrency() << " cores\n";
+    std::cout << "threads   seconds   hands/s   speedup\n";
+
+    double single = 0;
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      RummiKub::SolveBatch(
+          hands.tiles.data(),
+          hands.offsets.data(),
+          hands.size(),
+          solvable.get(),
+          threads);
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      // Every hand of the generator can be played
+      if (std::count(solvable.get(), solvable.get() + hand_count, false)) {
+        std::cout << "a solvable hand was not solved\n";
+        std::exit(1);
+      }
+
+      double seconds = elapsed.count();
+      if (threads == 1) single = seconds;
+      std::cout << std::setw(7) << threads << std::setw(10) << std::fixed
+                << std::setprecision(3) << seconds << std::setw(10)
+                << std::setprecision(0)
+                << static_cast<double>(hand_count) / seconds << std::setw(10)
+                << std::setprecision(2) << single / seconds << "\n";
+    }
+  }
+
+  /**
+   * @brief Hands of GenerateRandomSolvable(6, 13, 4), half of them with an
+   * extra tile, which usually makes them unsolvable and their search longer.
+   */
+  std::vector<std::vector<Tile>> LargeHands(size_t hand_count) {
+    std::mt19937 gen(280);
+    std::uniform_int_distribution<int> dis_denomination(0, kDenominations - 1);
+    std::uniform_int_distribution<int> dis_color(0, kColors - 1);
+
+    std::vector<std::vector<Tile>> hands;
+    while (hands.size() < hand_count) {
+      std::vector<Tile> hand = GenerateRandomSolvable(gen, 6, 13, 4);
+      if (hands.size() % 2) {
+        hand.push_back(
+            {dis_denomination(gen), static_cast<Color>(dis_color(gen))});
+      }
+      if (Fits(hand)) hands.push_back(hand);
+    }
+    return hands;
+  }
+
+  /**
+   * @brief Solve the same hands with BruteForceVirtual and BruteForce. Both
+   * search the same states, so the difference is the cost of calling the
+   * actions.
+   */
+  void BenchDispatch(size_t hand_count) {
+    std::vector<std::vector<Tile>> hands = LargeHands(hand_count);
+
+    std::cout << "dispatch: " << hand_count
+              << " hands of GenerateRandomSolvable(6, 13, 4)\n";
+    std::cout << "actions      nodes   seconds   nodes/s\n";
+
+    const RummiKub::Engine engines[] = {
+        RummiKub::BruteForceVirtual, RummiKub::BruteForce};
+    const char *names[] = {"virtual", "static"};
+
+    for (int i = 0; i < 2; i++) {
+      RummiKub solver(engines[i]);
+      uint64_t nodes = 0;
+
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      for (const std::vector<Tile> &hand: hands) {
+        for (const Tile &tile: hand) solver.Add(tile);
+        solver.Solve();
+        nodes += solver.GetNodeCount();
+      }
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      double seconds = elapsed.count();
+      std::cout << std::setw(7) << names[i] << std::setw(11) << nodes
+                << std::setw(10) << std::fixed << std::setprecision(3)
+                << seconds << std::setw(10) << std::setprecision(0)
+                << static_cast<double>(nodes) / seconds << "\n";
+    }
+  }
+
+  /**
+   * @brief Count the heap allocations of a solver reused with Reset() once it
+   * is warmed up: the same hands are solved twice and only the second time is
+   * counted. The hands mix small ones with large ones, which use the
+   * transposition table.
+   *
+   * @return false if an engine that should not allocate did.
+   */
+  bool BenchAllocations(size_t hand_count) {
+    std::mt19937 gen(280);
+    std::vector<std::vector<Tile>> hands;
+    while (hands.size() < hand_count) {
+      std::vector<Tile> hand = hands.size() % 2
+                                   ? GenerateRandomSolvable(gen, 6, 13, 4)
+                                   : GenerateRandomSolvable(gen, 2, 4, 2);
+      if (Fits(hand)) hands.push_back(hand);
+    }
+
+    std::cout << "allocations: " << hand_count << " hands, after warming up\n";
+    std::cout << "engine       allocations\n";
+
+    // BruteForceVirtual allocates its actions on purpose, it shows that the
+    // counting works
+    const RummiKub::Engine engines[] = {
+        RummiKub::BruteForce,
+        RummiKub::DynamicProgramming,
+        RummiKub::ExactCover,
+        RummiKub::BruteForceVirtual};
+    const char *names[] = {"brute-force", "dynamic", "cover", "virtual"};
+
+    bool clean = true;
+    for (int i = 0; i < 4; i++) {
+      RummiKub solver(engines[i]);
+      for (int pass = 0; pass < 2; pass++) {
+        allocations = 0;
+        counting = pass == 1;
+        for (const std::vector<Tile> &hand: hands) {
+          solver.Reset();
+          for (const Tile &tile: hand) solver.Add(tile);
+          solver.Solve();
+        }
+        counting = false;
+      }
+
+      std::cout << std::setw(11) << names[i] << std::setw(14) << allocations
+                << "\n";
+      if (engines[i] != RummiKub::BruteForceVirtual && allocations != 0) {
+        clean = false;
+      }
+    }
+
+    return clean;
+  }
+
+  /**
+   * @brief Solve the same hands with the statistics off and on, to show what
+   * collecting them costs, then print the statistics of all the hands.
+   */
+  void BenchStats(size_t hand_count) {
+    std::vector<std::vector<Tile>> hands = LargeHands(hand_count);
+
+    std::cout << "stats: " << hand_count
+              << " hands of GenerateRandomSolvable(6, 13, 4)\n";
+    std::cout << "stats   seconds\n";
+
+    SolverStats total = SolverStats{};
+    for (int enabled = 0; enabled < 2; enabled++) {
+      RummiKub solver;
+      solver.SetStatsEnabled(enabled == 1);
+
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      for (const std::vector<Tile> &hand: hands) {
+        for (const Tile &tile: hand) solver.Add(tile);
+        solver.Solve();
+        total.add(solver.GetStats());
+      }
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      std::cout << std::setw(5) << (enabled ? "on" : "off") << std::setw(10)
+                << std::fixed << std::setprecision(3) << elapsed.count()
+                << "\n";
+    }
+
+    std::cout << std::defaultfloat << std::setprecision(3) << total;
+  }
+
+  /**
+   * @brief Solve hands of test3 (test4 solves 1000 of them) without and with
+   * a trace written to memory, to show what sampling the search costs.
+   */
+  void BenchTrace(size_t hand_count) {
+    std::mt19937 gen(280);
+    std::vector<std::vector<Tile>> hands;
+    for (size_t i = 0; i < hand_count; i++) {
+      hands.push_back(GenerateRandomSolvable(gen, 2, 4, 2));
+    }
+
+    std::cout << "trace: " << hand_count << " hands of test3, a span every "
+              << RummiKub::kDefaultTraceInterval << " actions\n";
+    std::cout << "trace   seconds     bytes\n";
+
+    for (int traced = 0; traced < 2; traced++) {
+      std::ostringstream trace;
+      RummiKub solver;
+      if (traced) solver.SetTrace(&trace);
+
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      for (const std::vector<Tile> &hand: hands) {
+        for (const Tile &tile: hand) solver.Add(tile);
+        solver.Solve();
+      }
+      solver.SetTrace(nullptr);
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      std::cout << std::setw(5) << (traced ? "on" : "off") << std::setw(10)
+                << std::fixed << std::setprecision(3) << elapsed.count()
+                << std::setw(10) << trace.str().size() << "\n";
+    }
+  }
+
+  /**
+   * @brief A kind of hand the suite solves.
+   */
+  struct Workload {
+    const char *name;
+    std::vector<Tile> (*generate)(std::mt19937 &gen);
+  };
+
+  const Workload kWorkloads[] = {
+      {"test3",
+       [](std::mt19937 &gen) { return GenerateRandomSolvable(gen, 2, 4, 2); }},
+      {"solvable20",
+       [](std::mt19937 &gen) {
+         return GenerateSolvableOfSize(gen, 20, 2, 13);
+       }},
+      {"solvable30",
+       [](std::mt19937 &gen) {
+         return GenerateSolvableOfSize(gen, 30, 2, 13);
+       }},
+      {"solvable40",
+       [](std::mt19937 &gen) {
+         return GenerateSolvableOfSize(gen, 40, 2, 13);
+       }},
+      {"unsolvable30",
+       [](std::mt19937 &gen) { return GenerateUnsolvableOfSize(gen, 30); }},
+      // 30 tiles over the 24 tiles of 6 denominations, up to 4 copies each
+      {"duplicates30",
+       [](std::mt19937 &gen) {
+         return GenerateSolvableOfSize(gen, 30, kMaxCopies, 6);
+       }}};
+
+  /**
+   * @brief Check a play the way the driver does, without the tables of the
+   * solver: every run is of one color with sequences of 3 consecutive
+   * denominations or more, every group is of one denomination with 3 or 4
+   * colors, and the sets use every tile of the hand once. The hands of the
+   * suite have no jokers, so a joker makes the play wrong.
+   *
+   * @param solver The solver after Solve().
+   * @param hand The hand it solved.
+   * @return If the play is a legal partition of the hand.
+   */
+  bool LegalPlay(const RummiKub &solver, const std::vector<Tile> &hand) {
+    int copies[kDenominations][kColors] = {};
+    for (const Tile &tile: hand) copies[tile.denomination][tile.color]++;
+
+    // Takes the tiles of a set out of the hand
+    auto take = [&](TileRange set) {
+      for (const Tile &tile: set) {
+        if (tile.denomination < 0 || tile.denomination >= kDenominations ||
+            tile.color < 0 || tile.color >= kColors ||
+            --copies[tile.denomination][tile.color] < 0) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    for (size_t i = 0; i < solver.GetRunCount(); i++) {
+      TileRange run = solver.GetRun(i);
+      if (!take(run)) return false;
+
+      bool present[kDenominations] = {};
+      for (const Tile &tile: run) {
+        if (tile.color != run[0].color || present[tile.denomination]) {
+          return false;
+        }
+        present[tile.denomination] = true;
+      }
+
+      int length = 0;
+      for (int denomination = 0; denomination <= kDenominations;
+           denomination++) {
+        if (denomination < kDenominations && present[denomination]) {
+          length++;
+        } else if (length > 0 && length < 3) {
+          return false;
+        } else {
+          length = 0;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < solver.GetGroupCount(); i++) {
+      TileRange group = solver.GetGroup(i);
+      if (!take(group) || group.size() < 3 ||
+          group.size() > static_cast<size_t>(kColors)) {
+        return false;
+      }
+
+      bool present[kColors] = {};
+      for (const Tile &tile: group) {
+        if (tile.denomination != group[0].denomination ||
+            present[tile.color]) {
+          return false;
+        }
+        present[tile.color] = true;
+      }
+    }
+
+    for (const int (&row)[kColors]: copies) {
+      for (int count: row) {
+        if (count != 0) return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Solve every workload with every engine and print one line of CSV
+   * per pair: the hands solved, the nodes searched (brute force only), the
+   * throughput and the latency percentiles of a single Solve(). Each workload
+   * has its own seed, so changing one does not change the hands of another.
+   * The hands are solved once before timing them, so that the memory the
+   * solver keeps is already there, and every play of that first pass is
+   * checked with LegalPlay.
+   *
+   * @return false if an engine returned a play that is not legal.
+   */
+  bool BenchSuite(size_t hand_count) {
+    const RummiKub::Engine engines[] = {
+        RummiKub::BruteForce,
+        RummiKub::DynamicProgramming,
+        RummiKub::ExactCover};
+    const char *names[] = {"brute-force", "dynamic", "cover"};
+
+    std::cout << "workload,engine,hands,solved,nodes,seconds,hands_per_s,"
+                 "nodes_per_s,p50_us,p90_us,p99_us,max_us\n";
+
+    bool legal = true;
+    unsigned seed = 280;
+    for (const Workload &workload: kWorkloads) {
+      std::mt19937 gen(seed++);
+      std::vector<std::vector<Tile>> hands;
+      for (size_t i = 0; i < hand_count; i++) {
+        hands.push_back(workload.generate(gen));
+      }
+
+      std::vector<double> latencies(hand_count);
+      for (int i = 0; i < 3; i++) {
+        RummiKub solver(engines[i]);
+        size_t illegal = 0;
+        for (const std::vector<Tile> &hand: hands) {
+          for (const Tile &tile: hand) solver.Add(tile);
+          solver.Solve();
+          if (solver.GetRunCount() + solver.GetGroupCount() > 0 &&
+              !LegalPlay(solver, hand)) {
+            illegal++;
+          }
+        }
+        if (illegal > 0) {
+          std::cout << workload.name << "," << names[i] << ": " << illegal
+                    << " illegal plays\n";
+          legal = false;
+        }
+
+        size_t solved = 0;
+        uint64_t nodes = 0;
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (size_t hand = 0; hand < hand_count; hand++) {
+          std::chrono::steady_clock::time_point hand_start =
+              std::chrono::steady_clock::now();
+          for (const Tile &tile: hands[hand]) solver.Add(tile);
+          solver.Solve();
+          std::chrono::duration<double, std::micro> hand_elapsed =
+              std::chrono::steady_clock::now() - hand_start;
+
+          latencies[hand] = hand_elapsed.count();
+          nodes += solver.GetNodeCount();
+          if (solver.GetRunCount() + solver.GetGroupCount() > 0) solved++;
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double fraction) {
+          return latencies[static_cast<size_t>(
+              fraction * static_cast<double>(hand_count - 1))];
+        };
+
+        double seconds = elapsed.count();
+        std::cout << workload.name << "," << names[i] << "," << hand_count
+                  << "," << solved << "," << nodes << "," << std::fixed
+                  << std::setprecision(6) << seconds << ","
+                  << std::setprecision(0)
+                  << static_cast<double>(hand_count) / seconds << ","
+                  << static_cast<double>(nodes) / seconds << ","
+                  << std::setprecision(2) << percentile(0.5) << ","
+                  << percentile(0.9) << "," << percentile(0.99) << ","
+                  << latencies.back() << "\n";
+      }
+    }
+
+    return legal;
+  }
+
+  /**
+   * @brief Answer the same hands with Solve() and with IsSolvable(), using
+   * the brute-force engine, for the workloads of the suite. The hands that
+   * IsSolvable() answers without searching are the ones its filters reject.
+   *
+   * @return false if the two disagree on a hand.
+   */
+  bool BenchSolvable(size_t hand_count) {
+    std::cout << "solvable: " << hand_count
+              << " hands per workload, brute force\n";
+    std::cout << "    workload  solvable  filtered  solve_s  is_solvable_s\n";
+
+    bool agree = true;
+    unsigned seed = 280;
+    for (const Workload &workload: kWorkloads) {
+      std::mt19937 gen(seed++);
+      std::vector<std::vector<Tile>> hands;
+      for (size_t i = 0; i < hand_count; i++) {
+        hands.push_back(workload.generate(gen));
+      }
+
+      std::vector<bool> solved;
+      RummiKub solver;
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      for (const std::vector<Tile> &hand: hands) {
+        for (const Tile &tile: hand) solver.Add(tile);
+        solver.Solve();
+        solved.push_back(solver.GetRunCount() + solver.GetGroupCount() > 0);
+      }
+      std::chrono::duration<double> solve_elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      size_t solvable = 0;
+      size_t filtered = 0;
+      start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < hand_count; i++) {
+        for (const Tile &tile: hands[i]) solver.Add(tile);
+        bool answer = solver.IsSolvable();
+        if (answer != solved[i]) agree = false;
+        if (answer) solvable++;
+        if (solver.GetNodeCount() == 0) filtered++;
+      }
+      std::chrono::duration<double> check_elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      std::cout << std::setw(12) << workload.name << std::setw(10) << solvable
+                << std::setw(10) << filtered << std::setw(9) << std::fixed
+                << std::setprecision(4) << solve_elapsed.count()
+                << std::setw(15) << check_elapsed.count() << "\n";
+    }
+
+    return agree;
+  }
+
+  /**
+   * @brief An order for BruteForceMostConstrained that tries the groups before
+   * the runs: AddToGroup, AddToRun, CreateGroup, CreateRun.
+   */
+  void GroupsFirst(const Tile &, uint8_t order[SolverStats::kActions]) {
+    const uint8_t groups_first[SolverStats::kActions] = {1, 0, 3, 2};
+    std::copy(groups_first, groups_first + SolverStats::kActions, order);
+  }
+
+  /**
+   * @brief Solve the workloads of the suite and the large hands of the
+   * dispatch benchmark with BruteForce, which places the tiles in sorted
+   * order, and with BruteForceMostConstrained in the order of the handout and
+   * with GroupsFirst.
+   *
+   * @return false if the engines disagree on a hand.
+   */
+  bool BenchOrdering(size_t hand_count) {
+    std::vector<std::pair<std::string, std::vector<std::vector<Tile>>>> sets;
+    unsigned seed = 280;
+    for (const Workload &workload: kWorkloads) {
+      std::mt19937 gen(seed++);
+      std::vector<std::vector<Tile>> hands;
+      for (size_t i = 0; i < hand_count; i++) {
+        hands.push_back(workload.generate(gen));
+      }
+      sets.push_back({workload.name, hands});
+    }
+    sets.push_back({"large", LargeHands(hand_count)});
+
+    const RummiKub::Engine engines[] = {
+        RummiKub::BruteForce,
+        RummiKub::BruteForceMostConstrained,
+        RummiKub::BruteForceMostConstrained};
+    const RummiKub::ActionOrder orders[] = {nullptr, nullptr, GroupsFirst};
+    const char *names[] = {"sorted", "constrained", "groups-first"};
+
+    std::cout << "ordering: " << hand_count << " hands per workload\n";
+    std::cout << "    workload         order      nodes   seconds\n";
+
+    bool agree = true;
+    for (const std::pair<std::string, std::vector<std::vector<Tile>>> &set:
+         sets) {
+      std::vector<bool> solved(set.second.size());
+      for (int i = 0; i < 3; i++) {
+        RummiKub solver(engines[i]);
+        solver.SetActionOrder(orders[i]);
+        uint64_t nodes = 0;
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (size_t hand = 0; hand < set.second.size(); hand++) {
+          for (const Tile &tile: set.second[hand]) solver.Add(tile);
+          solver.Solve();
+          nodes += solver.GetNodeCount();
+
+          bool answer = solver.GetRunCount() + solver.GetGroupCount() > 0;
+          if (i == 0) solved[hand] = answer;
+          if (answer != solved[hand]) agree = false;
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        std::cout << std::setw(12) << set.first << std::setw(14) << names[i]
+                  << std::setw(11) << nodes << std::setw(10) << std::fixed
+                  << std::setprecision(4) << elapsed.count() << "\n";
+      }
+    }
+
+    return agree;
+  }
+
+  /**
+   * @brief A hand of a variant of the rules made of random runs of 3 to 5
+   * tiles and groups of 3 tiles up to every color, one set for every 16 tiles
+   * of the game. Every other hand gets an extra tile, which usually makes it
+   * unplayable.
+   *
+   * @param gen The random engine.
+   * @param extra If the hand gets an extra tile.
+   * @param counts Where to write the copies of every tile.
+   */
+  template<typename R>
+  void GenerateVariant(
+      std::mt19937 &gen,
+      bool extra,
+      int (&counts)[R::kDenominations][R::kColors]) {
+    const int kSets = R::kColors * R::kDenominations * R::kCopies / 16;
+    std::uniform_int_distribution<int> dis_denomination(
+        0, R::kDenominations - 1);
+    std::uniform_int_distribution<int> dis_color(0, R::kColors - 1);
+    std::uniform_int_distribution<int> dis_run(3, 5);
+    std::uniform_int_distribution<int> dis_group(3, R::kColors);
+    std::uniform_int_distribution<int> dis_coin(0, 1);
+
+    for (;;) {
+      std::fill(&counts[0][0], &counts[0][0] + sizeof(counts) / sizeof(int), 0);
+      for (int set = 0; set < kSets; set++) {
+        if (dis_coin(gen)) {
+          int length = dis_run(gen);
+          std::uniform_int_distribution<int> dis_start(
+              0, R::kDenominations - length);
+          int start = dis_start(gen);
+          int color = dis_color(gen);
+          for (int d = start; d < start + length; d++) counts[d][color]++;
+        } else {
+          int colors[R::kColors];
+          for (int color = 0; color < R::kColors; color++) {
+            colors[color] = color;
+          }
+          std::shuffle(colors, colors + R::kColors, gen);
+          int denomination = dis_denomination(gen);
+          for (int i = dis_group(gen); i > 0; i--) {
+            counts[denomination][colors[i - 1]]++;
+          }
+        }
+      }
+      if (extra) counts[dis_denomination(gen)][dis_color(gen)]++;
+
+      bool fits = true;
+      for (const int (&row)[R::kColors]: counts) {
+        for (int count: row) fits = fits && count <= R::kCopies;
+      }
+      if (fits) return;
+    }
+  }
+
+  /**
+   * @brief Check a play of FindPlay: every run is 3 tiles or more inside the
+   * denominations, every group is 3 colors or more of the variant, and the
+   * sets use every tile of the hand once.
+   *
+   * @param counts The copies of every tile in the hand.
+   * @param runs The runs of the play.
+   * @param groups The groups of the play.
+   * @return If the play is a legal partition of the hand.
+   */
+  template<typename R>
+  bool LegalVariantPlay(
+      const int (&counts)[R::kDenominations][R::kColors],
+      const std::vector<SweepRun> &runs,
+      const std::vector<SweepGroup> &groups) {
+    int left[R::kDenominations][R::kColors];
+    std::copy(&counts[0][0], &counts[0][0] + sizeof(left) / sizeof(int),
+              &left[0][0]);
+
+    for (const SweepRun &run: runs) {
+      if (run.color < 0 || run.color >= R::kColors || run.start < 0 ||
+          run.length < 3 || run.start + run.length > R::kDenominations) {
+        return false;
+      }
+      for (int d = run.start; d < run.start + run.length; d++) {
+        left[d][run.color]--;
+      }
+    }
+
+    for (const SweepGroup &group: groups) {
+      if (group.denomination < 0 || group.denomination >= R::kDenominations ||
+          group.colors >= 1u << R::kColors) {
+        return false;
+      }
+      int size = 0;
+      for (int color = 0; color < R::kColors; color++) {
+        if (group.colors & (1u << color)) {
+          left[group.denomination][color]--;
+          size++;
+        }
+      }
+      if (size < 3) return false;
+    }
+
+    for (const int (&row)[R::kColors]: left) {
+      for (int count: row) {
+        if (count != 0) return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Solve hands of a variant with the DynamicProgramming sweep
+   * specialized for it, and print a line of the table of BenchRules. The
+   * variants with the colors and denominations of the game are also solved
+   * by RummiKub, and the play of every playable hand is checked.
+   *
+   * @return false if RummiKub does not agree with the sweep on a hand, or a
+   * play of FindPlay is not legal.
+   */
+  template<typename R>
+  bool BenchVariant(size_t hand_count) {
+    struct Hand {
+      int counts[R::kDenominations][R::kColors];
+    };
+    std::mt19937 gen(280);
+    std::vector<Hand> hands(hand_count);
+    for (size_t i = 0; i < hand_count; i++) {
+      GenerateVariant<R>(gen, i % 2 == 1, hands[i].counts);
+    }
+
+    std::vector<bool> playable(hand_count);
+    double seconds = 0;
+    double slowest = 0;
+    for (size_t i = 0; i < hand_count; i++) {
+      std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      playable[i] = IsPlayable<R>(hands[i].counts);
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      seconds += elapsed.count();
+      slowest = std::max(slowest, elapsed.count());
+    }
+
+    const bool game = R::kColors == kColors &&
+                      R::kDenominations == kDenominations &&
+                      R::kCopies <= kMaxCopies;
+
+    bool agree = true;
+    size_t tiles = 0;
+    RummiKub solver(RummiKub::DynamicProgramming);
+    std::vector<SweepRun> runs;
+    std::vector<SweepGroup> groups;
+    for (size_t i = 0; i < hand_count; i++) {
+      if (FindPlay<R>(hands[i].counts, runs, groups) != playable[i] ||
+          (playable[i] &&
+           !LegalVariantPlay<R>(hands[i].counts, runs, groups))) {
+        agree = false;
+      }
+
+      for (int d = 0; d < R::kDenominations; d++) {
+        for (int color = 0; color < R::kColors; color++) {
+          int count = hands[i].counts[d][color];
+          tiles += static_cast<size_t>(count);
+          for (int copy = 0; game && copy < count; copy++) {
+            solver.Add(Tile{d, static_cast<Color>(color)});
+          }
+        }
+      }
+
+      if (game && solver.IsSolvable() != playable[i]) agree = false;
+      solver.Reset();
+    }
+
+    std::cout << std::setw(6) << R::kColors << std::setw(14)
+              << R::kDenominations << std::setw(7) << R::kCopies
+              << std::setw(7) << std::fixed << std::setprecision(1)
+              << static_cast<double>(tiles) / static_cast<double>(hand_count)
+              << std::setw(10)
+              << std::count(playable.begin(), playable.end(), true)
+              << std::setw(10) << std::setprecision(4) << seconds
+              << std::setw(9) << std::setprecision(2)
+              << seconds * 1e6 / static_cast<double>(hand_count)
+              << std::setw(10) << std::setprecision(0) << slowest * 1e6
+              << "\n";
+    return agree;
+  }
+
+  /**
+   * @brief How the DynamicProgramming sweep scales with the colors, the
+   * denominations and the copies of a tile, growing one of them at a time
+   * from the game with two copies, then all of them. The hands grow with the
+   * game.
+   *
+   * @return false if RummiKub does not agree with the sweep on a hand, or a
+   * play of a variant is not legal.
+   */
+  bool BenchRules(size_t hand_count) {
+    std::cout << "rules: " << hand_count << " hands per variant\n";
+    std::cout << "colors  denominations  copies  tiles  playable   seconds"
+                 "  us/hand    max_us\n";
+
+    bool agree = true;
+    agree = BenchVariant<GameRules>(hand_count) && agree;
+    agree = BenchVariant<Rules<5, 13, 2>>(hand_count) && agree;
+    agree = BenchVariant<Rules<6, 13, 2>>(hand_count) && agree;
+    agree = BenchVariant<Rules<4, 20, 2>>(hand_count) && agree;
+    agree = BenchVariant<Rules<4, 26, 2>>(hand_count) && agree;
+    agree = BenchVariant<Rules<4, 13, 3>>(hand_count) && agree;
+    agree = BenchVariant<Rules<4, 13, 4>>(hand_count) && agree;
+    agree = BenchVariant<Rules<5, 20, 3>>(hand_count) && agree;
+    return agree;
+  }
+
+  /**
+   * @brief Turn random tiles of a hand into jokers. A playable hand stays
+   * playable, as every joker can take the place of the tile it replaced.
+   *
+   * @param gen The random engine.
+   * @param hand The hand.
+   * @param jokers The amount of tiles to replace.
+   * @return The hand with the jokers.
+   */
+  std::vector<Tile> WithJokers(
+      std::mt19937 &gen, std::vector<Tile> hand, int jokers) {
+    std::shuffle(hand.begin(), hand.end(), gen);
+    for (int i = 0; i < jokers; i++) hand[static_cast<size_t>(i)] = {0, Joker};
+    std::shuffle(hand.begin(), hand.end(), gen);
+    return hand;
+  }
+
+  /**
+   * @brief Solve playable and unplayable hands of 12, 20 and 30 tiles with 0,
+   * 1 and 2 of their tiles turned into jokers, timing BruteForce and checking
+   * its answers against BruteForceMostConstrained.
+   *
+   * @return false if a playable hand is not played or the engines disagree.
+   */
+  bool BenchJokers(size_t hand_count) {
+    std::cout << "jokers: " << hand_count << " hands per row\n";
+    std::cout << "tiles  jokers      source  playable      nodes   seconds"
+                 "  us/hand    max_us\n";
+
+    bool agree = true;
+    for (int size: {12, 20, 30}) {
+      for (int jokers = 0; jokers <= kMaxJokers; jokers++) {
+        for (int playable_source = 1; playable_source >= 0;
+             playable_source--) {
+          std::mt19937 gen(static_cast<unsigned>(size * 10 + jokers));
+          std::vector<std::vector<Tile>> hands;
+          for (size_t i = 0; i < hand_count; i++) {
+            std::vector<Tile> hand =
+                playable_source ? GenerateSolvableOfSize(gen, size, 2, 13)
+                                : GenerateUnsolvableOfSize(gen, size);
+            hands.push_back(WithJokers(gen, hand, jokers));
+          }
+
+          RummiKub solver(RummiKub::BruteForce);
+          RummiKub checker(RummiKub::BruteForceMostConstrained);
+          size_t playable = 0;
+          uint64_t nodes = 0;
+          double seconds = 0;
+          double slowest = 0;
+          for (const std::vector<Tile> &hand: hands) {
+            for (const Tile &tile: hand) solver.Add(tile);
+            std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+            solver.Solve();
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            seconds += elapsed.count();
+            slowest = std::max(slowest, elapsed.count());
+            nodes += solver.GetNodeCount();
+
+            bool answer = solver.GetRunCount() + solver.GetGroupCount() > 0;
+            for (const Tile &tile: hand) checker.Add(tile);
+            checker.Solve();
+            bool checked = checker.GetRunCount() + checker.GetGroupCount() > 0;
+            if (answer != checked || (playable_source && !answer)) {
+              agree = false;
+            }
+            if (answer) playable++;
+          }
+
+          std::cout << std::setw(5) << size << std::setw(8) << jokers
+                    << std::setw(12)
+                    << (playable_source ? "playable" : "unplayable")
+                    << std::setw(10) << playable << std::setw(11) << nodes
+                    << std::setw(10) << std::fixed << std::setprecision(4)
+                    << seconds << std::setw(9) << std::setprecision(1)
+                    << seconds * 1e6 / static_cast<double>(hand_count)
+                    << std::setw(10) << slowest * 1e6 << "\n";
+        }
+      }
+    }
+
+    return agree;
+  }
+
+  /**
+   * @brief A hand drawn from a shuffled set of the 104 tiles of the game, like
+   * the rack of a player late in a game.
+   *
+   * @param gen The random engine.
+   * @param size The amount of tiles.
+   */
+  std::vector<Tile> DrawRack(std::mt19937 &gen, int size) {
+    std::vector<Tile> tiles;
+    for (int denomination = 0; denomination < kDenominations; denomination++) {
+      for (int color = 0; color < kColors; color++) {
+        tiles.push_back({denomination, static_cast<Color>(color)});
+        tiles.push_back({denomination, static_cast<Color>(color)});
+      }
+    }
+    std::shuffle(tiles.begin(), tiles.end(), gen);
+    tiles.resize(static_cast<size_t>(size));
+    return tiles;
+  }
+
+  /**
+   * @brief Value of the tiles a solver played out of a hand.
+   *
+   * @param solver The solver after Solve().
+   * @param hand The hand it solved.
+   * @param objective What the value counts.
+   * @return The value, -1 if the play and the leftover are not the hand.
+   */
+  int PlayedValue(
+      const RummiKub &solver,
+      const std::vector<Tile> &hand,
+      RummiKub::Objective objective) {
+    int copies[kDenominations][kColors] = {};
+    for (const Tile &tile: hand) copies[tile.denomination][tile.color]++;
+    for (const Tile &tile: solver.GetLeftover()) {
+      copies[tile.denomination][tile.color]--;
+    }
+
+    int value = 0;
+    auto play = [&](TileRange set) {
+      for (const Tile &tile: set) {
+        copies[tile.denomination][tile.color]--;
+        value += objective == RummiKub::MostPoints ? tile.denomination + 1 : 1;
+      }
+    };
+    for (size_t i = 0; i < solver.GetRunCount(); i++) play(solver.GetRun(i));
+    for (size_t i = 0; i < solver.GetGroupCount(); i++) {
+      play(solver.GetGroup(i));
+    }
+
+    for (const int (&row)[kColors]: copies) {
+      for (int count: row) {
+        if (count != 0) return -1;
+      }
+    }
+    return value;
+  }
+
+  /**
+   * @brief Find the most tiles and the most points of racks of 30 to 60
+   * tiles, without a time budget (up to 40 tiles) and with a budget of a
+   * millisecond. The value column is the average value played.
+   *
+   * @return false if a play does not account for its hand, or a play under
+   * the budget beats the one without.
+   */
+  bool BenchSubset(size_t hand_count) {
+    std::cout << "subset: " << hand_count << " hands per row\n";
+    std::cout << "tiles   objective  budget_us     value  us/hand    max_us"
+                 "  timed_out\n";
+
+    const RummiKub::Objective objectives[] = {
+        RummiKub::MostTiles, RummiKub::MostPoints};
+    const char *names[] = {"tiles", "points"};
+
+    bool agree = true;
+    for (int size: {30, 40, 50, 60}) {
+      std::mt19937 gen(static_cast<unsigned>(size));
+      std::vector<std::vector<Tile>> hands;
+      for (size_t i = 0; i < hand_count; i++) {
+        hands.push_back(DrawRack(gen, size));
+      }
+
+      for (int o = 0; o < 2; o++) {
+        std::vector<int> exact;
+        for (double budget: {0.0, 0.001}) {
+          // The larger racks can take seconds to prove
+          if (budget == 0 && size > 40) continue;
+
+          RummiKub solver;
+          solver.SetObjective(objectives[o]);
+          solver.SetTimeBudget(budget);
+          double seconds = 0;
+          double slowest = 0;
+          long total = 0;
+          size_t timed_out = 0;
+          for (size_t hand = 0; hand < hands.size(); hand++) {
+            for (const Tile &tile: hands[hand]) solver.Add(tile);
+            std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+            solver.Solve();
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            seconds += elapsed.count();
+            slowest = std::max(slowest, elapsed.count());
+            if (solver.TimedOut()) timed_out++;
+
+            int value = PlayedValue(solver, hands[hand], objectives[o]);
+            if (value < 0) agree = false;
+            if (budget == 0) {
+              exact.push_back(value);
+            } else if (!exact.empty() && value > exact[hand]) {
+              agree = false;
+            }
+            total += value;
+          }
+
+          double count = static_cast<double>(hand_count);
+          std::cout << std::setw(5) << size << std::setw(12) << names[o]
+                    << std::fixed << std::setprecision(0) << std::setw(11)
+                    << budget * 1e6 << std::setw(10) << std::setprecision(2)
+                    << static_cast<double>(total) / count << std::setw(9)
+                    << std::setprecision(1) << seconds * 1e6 / count
+                    << std::setw(10) << slowest * 1e6 << std::setw(11)
+                    << timed_out << "\n";
+        }
+      }
+    }
+
+    return agree;
+  }
+
+  // Solves of an instance timed, the fastest one is kept
+  const int kRegressionRepeats = 5;
+
+  // Hands of every workload of the suite in the corpus
+  const int kRegressionHandsPerWorkload = 16;
+
+  // Times below this many microseconds are only clock noise
+  const double kRegressionMinMicroseconds = 20;
+
+  /**
+   * @brief A hand of the regression corpus.
+   */
+  struct Instance {
+    std::string name;
+    std::vector<Tile> hand;
+  };
+
+  /**
+   * @brief The hands of test0 to test2 of the driver, the hand of custom.cpp
+   * (which an earlier version solved incorrectly), the hands of the suite and
+   * the large hands of the dispatch benchmark.
+   */
+  std::vector<Instance> RegressionCorpus() {
+    std::vector<Instance> corpus;
+    corpus.push_back(
+        {"test0",
+         {{1, Red}, {2, Red}, {3, Red}, {3, Red}, {4, Red}, {5, Red}}});
+    corpus.push_back(
+        {"test1",
+         {{6, Yellow},
+          {8, Yellow},
+          {7, Yellow},
+          {5, Red},
+          {5, Blue},
+          {5, Green},
+          {5, Yellow},
+          {1, Red},
+          {2, Red},
+          {3, Red},
+          {3, Red},
+          {4, Red},
+          {5, Red}}});
+    corpus.push_back(
+        {"test2",
+         {{6, Yellow},
+          {8, Yellow},
+          {5, Green},
+          {5, Yellow},
+          {1, Red},
+          {2, Red},
+          {4, Red},
+          {5, Red}}});
+    corpus.push_back(
+        {"custom",
+         {{12, Yellow},
+          {6, Blue},
+          {7, Blue},
+          {9, Yellow},
+          {5, Blue},
+          {10, Yellow},
+          {11, Yellow},
+          {7, Red},
+          {7, Red},
+          {7, Green},
+          {7, Yellow},
+          {4, Blue},
+          {7, Green}}});
+
+    unsigned seed = 280;
+    for (const Workload &workload: kWorkloads) {
+      std::mt19937 gen(seed++);
+      for (int i = 0; i < kRegressionHandsPerWorkload; i++) {
+        corpus.push_back(
+            {std::string(workload.name) + "#" + std::to_string(i),
+             workload.generate(gen)});
+      }
+    }
+
+    std::vector<std::vector<Tile>> large =
+        LargeHands(kRegressionHandsPerWorkload);
+    for (size_t i = 0; i < large.size(); i++) {
+      corpus.push_back({"large#" + std::to_string(i), large[i]});
+    }
+
+    return corpus;
+  }
+
+  /**
+   * @brief What an instance costs the brute-force engine.
+   */
+  struct Measure {
+    uint64_t nodes;
+    double microseconds;
+  };
+
+  /**
+   * @brief Solve every instance of the corpus kRegressionRepeats times.
+   *
+   * @param corpus The instances.
+   * @return The nodes and the fastest time of every instance.
+   */
+  std::vector<Measure> MeasureCorpus(const std::vector<Instance> &corpus) {
+    std::vector<Measure> measures;
+    RummiKub solver;
+    for (const Instance &instance: corpus) {
+      Measure measure{0, 0};
+      for (int repeat = 0; repeat < kRegressionRepeats; repeat++) {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for (const Tile &tile: instance.hand) solver.Add(tile);
+        solver.Solve();
+        std::chrono::duration<double, std::micro> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        measure.nodes = solver.GetNodeCount();
+        if (repeat == 0 || elapsed.count() < measure.microseconds) {
+          measure.microseconds = elapsed.count();
+        }
+      }
+      measures.push_back(measure);
+    }
+    return measures;
+  }
+
+  /**
+   * @brief Measure the corpus and write it as the new baseline.
+   *
+   * @param path The baseline file.
+   * @return false if the file could not be written.
+   */
+  bool WriteBaseline(const std::string &path) {
+    std::vector<Instance> corpus = RegressionCorpus();
+    std::vector<Measure> measures = MeasureCorpus(corpus);
+
+    std::ofstream out(path);
+    if (!out) {
+      std::cout << "cannot write " << path << "\n";
+      return false;
+    }
+
+    out << "instance,tiles,nodes,microseconds\n";
+    for (size_t i = 0; i < corpus.size(); i++) {
+      out << corpus[i].name << "," << corpus[i].hand.size() << ","
+          << measures[i].nodes << "," << std::fixed << std::setprecision(2)
+          << measures[i].microseconds << "\n";
+    }
+
+    std::cout << "baseline: " << corpus.size() << " instances written to "
+              << path << "\n";
+    return true;
+  }
+
+  /**
+   * @brief Measure the corpus and compare it with the baseline. An instance
+   * regresses when it searches more than node_ratio times its nodes, or takes
+   * more than time_ratio times its time (times under
+   * kRegressionMinMicroseconds are not compared). The times depend on the
+   * machine that wrote the baseline, so they are only compared when asked
+   * for: a time_ratio of 0, the default, only compares nodes.
+   *
+   * @param path The baseline file.
+   * @param node_ratio The growth of the nodes allowed.
+   * @param time_ratio The growth of the time allowed (0 to not compare).
+   * @return false if an instance regressed or is not in the baseline.
+   */
+  bool CheckBaseline(
+      const std::string &path, double node_ratio, double time_ratio) {
+    std::ifstream in(path);
+    if (!in) {
+      std::cout << "cannot read " << path << "\n";
+      return false;
+    }
+
+    std::map<std::string, Measure> baseline;
+    std::string line;
+    std::getline(in, line); // header
+    while (std::getline(in, line)) {
+      std::istringstream fields(line);
+      std::string name, tiles, nodes, microseconds;
+      if (std::getline(fields, name, ',') && std::getline(fields, tiles, ',') &&
+          std::getline(fields, nodes, ',') &&
+          std::getline(fields, microseconds, ',')) {
+        baseline[name] = Measure{
+            std::strtoull(nodes.c_str(), nullptr, 10),
+            std::strtod(microseconds.c_str(), nullptr)};
+      }
+    }
+
+    std::vector<Instance> corpus = RegressionCorpus();
+    std::vector<Measure> measures = MeasureCorpus(corpus);
+
+    std::cout << "regression: " << corpus.size() << " instances against "
+              << path << ", nodes up to x" << node_ratio;
+    if (time_ratio > 0) std::cout << ", time up to x" << time_ratio;
+    std::cout << "\n";
+
+    size_t failures = 0;
+    for (size_t i = 0; i < corpus.size(); i++) {
+      const Measure &now = measures[i];
+      std::map<std::string, Measure>::const_iterator found =
+          baseline.find(corpus[i].name);
+      if (found == baseline.end()) {
+        std::cout << corpus[i].name << ": not in the baseline\n";
+        failures++;
+        continue;
+      }
+
+      const Measure &before = found->second;
+      bool nodes_grew = static_cast<double>(now.nodes) >
+                        node_ratio * static_cast<double>(before.nodes);
+      bool time_grew = time_ratio > 0 &&
+                       now.microseconds >= kRegressionMinMicroseconds &&
+                       now.microseconds > time_ratio * before.microseconds;
+      if (nodes_grew || time_grew) {
+        std::cout << corpus[i].name << ": nodes " << before.nodes << " -> "
+                  << now.nodes << ", microseconds " << std::fixed
+                  << std::setprecision(2) << before.microseconds << " -> "
+                  << now.microseconds << "\n";
+        failures++;
+      }
+    }
+
+    std::cout << failures << " instances regressed\n";
+    return failures == 0;
+  }
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string mode = argc > 1 ? argv[1] : "";
+  size_t hand_count = 0;
+  if (argc > 2) hand_count = std::strtoul(argv[2], nullptr, 10);
+
+  unsigned max_threads = std::thread::hardware_concurrency();
+  if (argc > 3) {
+    max_threads = static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10));
+  }
+  if (max_threads == 0) max_threads = 1;
+
+  try {
+    if (mode == "regression") {
+      std::string path = argc > 2 ? argv[2] : BENCH_BASELINE;
+      double node_ratio = argc > 3 ? std::strtod(argv[3], nullptr) : 1.25;
+      double time_ratio = argc > 4 ? std::strtod(argv[4], nullptr) : 0;
+      return CheckBaseline(path, node_ratio, time_ratio) ? 0 : 1;
+    }
+    if (mode == "baseline") {
+      return WriteBaseline(argc > 2 ? argv[2] : BENCH_BASELINE) ? 0 : 1;
+    }
+    if (mode == "suite") {
+      if (!BenchSuite(hand_count ? hand_count : 1000)) {
+        std::cout << "an engine returned an illegal play\n";
+        return 1;
+      }
+      return 0;
+    }
+    if (mode.empty() || mode == "batch") {
+      BenchBatch(hand_count ? hand_count : 200000, max_threads);
+    }
+    if (mode.empty() || mode == "dispatch") {
+      BenchDispatch(hand_count ? hand_count : 1000);
+    }
+    if (mode.empty() || mode == "stats") {
+      BenchStats(hand_count ? hand_count : 1000);
+    }
+    if (mode.empty() || mode == "trace") {
+      BenchTrace(hand_count ? hand_count : 100000);
+    }
+    if (mode.empty() || mode == "solvable") {
+      if (!BenchSolvable(hand_count ? hand_count : 1000)) {
+        std::cout << "IsSolvable() and Solve() disagree\n";
+        return 1;
+      }
+    }
+    if (mode.empty() || mode == "ordering") {
+      if (!BenchOrdering(hand_count ? hand_count : 1000)) {
+        std::cout << "the orders disagree\n";
+        return 1;
+      }
+    }
+    if (mode.empty() || mode == "rules") {
+      if (!BenchRules(hand_count ? hand_count : 1000)) {
+        std::cout << "RummiKub and the sweep disagree, or a play is wrong\n";
+        return 1;
+      }
+    }
+    if (mode.empty() || mode == "jokers") {
+      if (!BenchJokers(hand_count ? hand_count : 1000)) {
+        std::cout << "the engines disagree on a hand with jokers\n";
+        return 1;
+      }
+    }
+    if (mode.empty() || mode == "subset") {
+      if (!BenchSubset(hand_count ? hand_count : 1000)) {
+        std::cout << "a play of the best part of a hand is wrong\n";
+        return 1;
+      }
+    }
+    if (mode.empty() || mode == "allocations") {
+      if (!BenchAllocations(hand_count ? hand_count : 1000)) {
+        std::cout << "a solve allocated memory\n";
+        return 1;
+      }
+    }
+  } catch (const char *error) {
+    std::cout << error << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
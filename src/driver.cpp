@@ -1,6 +1,5 @@
 #include <algorithm>
 #include <iostream>
-#include <map>
 #include "rummikub.h"
 
 bool CheckSolution(
@@ -16,7 +15,9 @@ bool CheckSolution(
     for (Tile const &t: r) {
       auto it = std::find_if(
           original_hand.begin(), original_hand.end(), [&t](Tile const &t1) {
-            return t.color == t1.color && t.denomination == t1.denomination;
+            // a joker of the hand may stand for any tile
+            return t.color == t1.color &&
+                   (t.color == Joker || t.denomination == t1.denomination);
           });
       if (it == original_hand.end()) {
         std::cout << "Tile " << t
@@ -31,7 +32,9 @@ bool CheckSolution(
     for (Tile const &t: g) {
       auto it = std::find_if(
           original_hand.begin(), original_hand.end(), [&t](Tile const &t1) {
-            return t.color == t1.color && t.denomination == t1.denomination;
+            // a joker of the hand may stand for any tile
+            return t.color == t1.color &&
+                   (t.color == Joker || t.denomination == t1.denomination);
           });
       if (it == original_hand.end()) {
         std::cout << "Tile " << t
@@ -53,80 +56,70 @@ bool CheckSolution(
 
   // check groups are legal
   for (auto const &g: groups) {
-    unsigned long size = g.size();
-    if (size > 0) { // skip if empty
-      if (size < 3 || size > 4) {
-        std::cout << "Group has incorrect size\n";
+    if (g.empty()) continue; // skip if empty
+
+    unsigned colors = 0;
+    int jokers = 0;
+    for (Tile const &t: g) {
+      // a bad tile must not reach the shifts and the table below
+      if (t.denomination < 0 || t.denomination >= kDenominations ||
+          t.color < Red || t.color > Joker) {
+        std::cout << "Group contains tile " << t << " out of range\n";
+        correct = false;
+        continue;
+      }
+      if (t.denomination != g[0].denomination) {
+        std::cout << "Group denominations do not match\n";
         correct = false;
-      } else { // size is 3 or 4
-        int denomination = g[0].denomination;
-        std::map<Color, int> counts;
-        for (unsigned long i = 0; i < size; ++i) {
-          if (g[i].denomination != denomination) {
-            std::cout << "Group denominations do not match\n";
-            correct = false;
-          }
-          ++counts[g[i].color];
-        }
-
-        // check counts of colors
-        for (auto const &c: counts) {
-          if (c.second > 1) {
-            std::cout << "Group contains tiles of the same color\n";
-            correct = false;
-          }
-        }
       }
+      if (t.color == Joker) {
+        jokers++;
+        continue;
+      }
+      if (colors & (1u << t.color)) {
+        std::cout << "Group contains tiles of the same color\n";
+        correct = false;
+      }
+      colors |= 1u << t.color;
+    }
+
+    // the same table the solver checks its groups with, a joker takes the
+    // place of a missing color
+    SetRule rule = GroupRule(colors);
+    if (g.size() > static_cast<size_t>(kColors) ||
+        (!rule.legal() && jokers < rule.needed())) {
+      std::cout << "Group has incorrect size\n";
+      correct = false;
     }
   }
 
   // check runs are legal
   for (auto const &r: runs) {
-    int counts[13] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-
-    Color color = r[0].color;
-
-    for (unsigned long i = 0; i < r.size(); ++i) {
-      if (r[i].color != color) {
+    unsigned denominations = 0;
+    Color color = Joker;
+    for (Tile const &t: r) {
+      if (t.denomination < 0 || t.denomination >= kDenominations ||
+          t.color < Red || t.color > Joker) {
+        std::cout << "Run contains tile " << t << " out of range\n";
+        correct = false;
+        continue;
+      }
+      if (t.color != Joker && color == Joker) color = t.color;
+      if (t.color != Joker && t.color != color) {
         std::cout << "Run colors do not match\n";
         correct = false;
       }
-      ++counts[r[i].denomination];
-    }
-
-    for (int const &c: counts) {
-      if (c > 1) {
+      if (denominations & (1u << t.denomination)) {
         std::cout << "Run contains tiles of the same denomination\n";
         correct = false;
       }
+      denominations |= 1u << t.denomination;
     }
 
-    // 123--6789--- is a valid run
-    if (correct) {
-      int len = 0;
-      for (int b: counts) {
-        if (b) { // is tile
-          if (len > 0) { // continued run
-            ++len;
-          } else { // new run started
-            len = 1;
-          }
-        } else { // no tile
-          if (len > 0) { // run ended
-            if (len < 3) {
-              std::cout << "Run contains less than 3 tiles \n";
-              correct = false;
-            }
-            len = 0; // not really necessary, see "len=1" above
-          } else { // no tile and no run going
-          }
-        }
-      }
-      // check the length of the last run
-      if (counts[12] && len < 3) {
-        correct = false;
-        std::cout << "Run contains less than 3 tiles \n";
-      }
+    // 123--6789--- is a valid run, every sequence needs 3 tiles or more
+    if (!RunRule(denominations).legal()) {
+      std::cout << "Run contains less than 3 tiles \n";
+      correct = false;
     }
   }
   return correct;
@@ -7,15 +7,86 @@
  */
 
 #include "rummikub.h"
+#include "rummikub_bits.h"
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iosfwd>
 #include <iostream>
 #include <ostream>
+#include <utility>
 
 #define DEBUG 0
 
-// NOTE: You are allowed to sort the hand. Nature is healing.
-#define SORT_HAND 1
+// Backtrack as soon as a set can no longer be completed instead of at a leaf
+#define FORWARD_CHECK 1
+
+// Remember the states that failed (relies on the forward checking to know
+// that the sets that can no longer change are legal)
+#define TRANSPOSITION_TABLE 1
+
+// Solve the parts of the hand that cannot share a set one at a time
+#define DECOMPOSE_HAND 1
+
+#if TRANSPOSITION_TABLE && !FORWARD_CHECK
+  #error "TRANSPOSITION_TABLE needs FORWARD_CHECK"
+#endif
+
+namespace {
+  const size_t kDefaultTranspositionBytes = size_t{1} << 18;
+
+  // Subtrees with less tiles than this are cheaper to search than to remember
+  const int kTranspositionMinTiles = 6;
+
+  // Smaller hands are solved faster than the table can be cleared
+  const int kTranspositionMinHand = 20;
+
+  // At most 12 groups of 4 bits fit in Transposition::groups
+  const int kMaxOpenGroups = 12;
+
+  // Spans of the trace kept before they are written
+  const size_t kTraceFlushSpans = 4096;
+
+  // The search for the best part of a hand reads the clock when the states
+  // searched are a multiple of this + 1
+  const uint64_t kSubsetClockMask = 63;
+
+  const char *const kActionNames[SolverStats::kActions] = {
+      "AddToRun", "AddToGroup", "CreateRun", "CreateGroup"};
+
+  /**
+   * @brief Nanoseconds in a duration of the steady clock.
+   */
+  uint64_t nanoseconds(std::chrono::steady_clock::duration duration) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+            .count());
+  }
+
+  /**
+   * @brief Add the time an object lives to a phase of SolverStats, if the
+   * statistics are on.
+   */
+  class PhaseTimer {
+  public:
+    PhaseTimer(bool enabled, double &seconds) :
+        seconds(enabled ? &seconds : nullptr) {
+      if (enabled) start = std::chrono::steady_clock::now();
+    }
+
+    ~PhaseTimer() {
+      if (seconds != nullptr) {
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        *seconds += elapsed.count();
+      }
+    }
+
+  private:
+    double *seconds;
+    std::chrono::steady_clock::time_point start;
+  };
+} // namespace
 
 #if DEBUG
 template<typename T, typename... Args>
@@ -30,19 +101,20 @@ void dbg(T &&x) {
 }
 
 /**
- * @brief Helper function to print a vector of T
+ * @brief Helper function to print a range of T
  *
- * @param vec Reference to vector to print.
+ * @param first Pointer to the first item to print.
+ * @param last Pointer past the last item to print.
  */
 template<typename T>
-void print_vector(const std::vector<T> &vec) {
-  for (const T &t: vec) {
-    std::cout << t << std::endl;
+void print_range(const T *first, const T *last) {
+  for (const T *t = first; t != last; t++) {
+    std::cout << *t << std::endl;
   }
 }
 #else
   #define dbg(...)
-  #define print_vector(...)                                                    \
+  #define print_range(...)                                                    \
     do {                                                                       \
       std::ignore = std::make_tuple(__VA_ARGS__);                              \
     } while (false)
@@ -55,17 +127,182 @@ std::ostream &operator<<(std::ostream &os, Tile const &t) {
     case Green: os << "G"; break;
     case Blue: os << "B"; break;
     case Yellow: os << "Y"; break;
+    case Joker: os << "J"; break;
   }
   os << " }";
   return os;
 }
 
 /**
- * @brief Function to help find the index in a vector<T> by using function F.
+ * @brief The denominations that have tiles of at least 3 colors, the only ones
+ * that can make a group.
+ *
+ * @param tiles A mask of tiles (bit denomination * kColors + color).
+ * @return The tiles of those denominations, all 4 bits of each.
+ */
+inline uint64_t group_denominations(uint64_t tiles) {
+  const uint64_t kEvenBits = 0x5555555555555555;
+  const uint64_t kPairBits = 0x3333333333333333;
+  const uint64_t kNibbleBits = 0x1111111111111111;
+
+  // Colors of every denomination, counted in its own 4 bits
+  uint64_t pairs = (tiles & kEvenBits) + ((tiles >> 1) & kEvenBits);
+  uint64_t colors = (pairs & kPairBits) + ((pairs >> 2) & kPairBits);
+  uint64_t three_colors = ((colors >> 2) | ((colors >> 1) & colors)) &
+                          kNibbleBits;
+  return three_colors * 0xF;
+}
+
+/**
+ * @brief The tiles a tile can be linked to through sets: a run links a tile to
+ * the tiles of its color next to it, and a group to the other tiles of its
+ * denomination, if it has 3 colors. No set can take tiles of two of these
+ * components, so each one can be solved on its own.
+ *
+ * @param tiles A mask of tiles.
+ * @param index The bit index of a tile of the mask.
+ * @return The mask of the tiles linked to it, itself included.
+ */
+inline uint64_t connected_tiles(uint64_t tiles, int index) {
+  const uint64_t kNibbleBits = 0x1111111111111111;
+  uint64_t grouped = group_denominations(tiles);
+
+  uint64_t component = uint64_t{1} << index;
+  for (;;) {
+    uint64_t in_group = component & grouped;
+    uint64_t denominations =
+        (in_group | (in_group >> 1) | (in_group >> 2) | (in_group >> 3)) &
+        kNibbleBits;
+
+    uint64_t grown = (component | (component << kColors) |
+                      (component >> kColors) | denominations * 0xF) &
+                     tiles;
+    if (grown == component) {
+      return component;
+    }
+    component = grown;
+  }
+}
+
+/**
+ * @brief The tiles whose points (denomination + 1) have a bit set.
+ *
+ * @param bit The bit of the points.
+ * @param denomination The first denomination to look at.
+ * @return All 4 bits of every such denomination.
+ */
+constexpr uint64_t points_plane(int bit, int denomination = 0) {
+  return denomination == kDenominations
+             ? 0
+             : ((((denomination + 1) >> bit) & 1)
+                    ? uint64_t{0xF} << (denomination * kColors)
+                    : 0) |
+                   points_plane(bit, denomination + 1);
+}
+
+/**
+ * @brief The tiles of a mask that are in a window of 3 denominations of their
+ * color all in the mask, the only ones that can make a run.
+ *
+ * @param tiles A mask of tiles (bit denomination * kColors + color).
+ * @return Those tiles.
+ */
+inline uint64_t run_windows(uint64_t tiles) {
+  uint64_t starts = tiles & (tiles >> kColors) & (tiles >> (2 * kColors));
+  return tiles &
+         (starts | (starts << kColors) | (starts << (2 * kColors)));
+}
+
+// Jokers needed by a run that no amount of them makes legal
+const int kUnfillable = 100;
+
+/**
+ * @brief The fewest jokers that make a run legal, by filling gaps between its
+ * sequences or extending them. Scans the denominations from the top down,
+ * keeping the fewest jokers for the rest of the run after a sequence of 0, 1,
+ * 2 and 3 or more tiles.
+ *
+ * @param mask The denominations of the run.
+ * @param free Denominations the run can get without a joker.
+ * @param fill Where to write the denominations the jokers take, may be
+ * nullptr.
+ * @return The amount of jokers, kUnfillable or more if there is none.
+ */
+inline int run_jokers(unsigned mask, unsigned free, unsigned *fill) {
+  int cost[kDenominations + 1][4];
+  for (int length = 0; length < 4; length++) {
+    cost[kDenominations][length] =
+        length == 0 || length == 3 ? 0 : kUnfillable;
+  }
+
+  for (int denomination = kDenominations - 1; denomination >= 0;
+       denomination--) {
+    for (int length = 0; length < 4; length++) {
+      int taken = cost[denomination + 1][length == 3 ? 3 : length + 1];
+      if ((mask >> denomination) & 1) {
+        cost[denomination][length] = taken;
+        continue;
+      }
+
+      // A sequence may only stop once it has 3 tiles
+      int filled = taken + (((free >> denomination) & 1) ? 0 : 1);
+      int empty = length == 0 || length == 3 ? cost[denomination + 1][0]
+                                             : kUnfillable;
+      cost[denomination][length] = std::min(filled, empty);
+    }
+  }
+
+  if (fill != nullptr) {
+    *fill = 0;
+    int length = 0;
+    for (int denomination = 0; denomination < kDenominations; denomination++) {
+      if (!((mask >> denomination) & 1)) {
+        if ((length == 0 || length == 3) &&
+            cost[denomination + 1][0] == cost[denomination][length]) {
+          length = 0;
+          continue;
+        }
+        if (!((free >> denomination) & 1)) *fill |= 1u << denomination;
+      }
+      length = length == 3 ? 3 : length + 1;
+    }
+  }
+
+  return cost[0][0];
+}
+
+/**
+ * @brief The denominations of the tiles of one color.
+ *
+ * @param tiles A mask of tiles (bit denomination * kColors + color).
+ * @param color The color.
+ * @return Bit d set when the mask has the tile of denomination d.
+ */
+inline unsigned color_denominations(uint64_t tiles, int color) {
+  unsigned denominations = 0;
+  for (int denomination = 0; denomination < kDenominations; denomination++) {
+    if ((tiles >> (denomination * kColors + color)) & 1) {
+      denominations |= 1u << denomination;
+    }
+  }
+  return denominations;
+}
+
+/**
+ * @brief Amount a set adds to Table::deficient.
+ *
+ * @param legal If the set is legal.
+ * @return 0 for a legal set and 1 otherwise.
+ */
+inline int deficiency(bool legal) { return legal ? 0 : 1; }
+
+/**
+ * @brief Function to help find the index in an array of T by using function F.
  * This is to reduce the amount of searches that are boilerplate enough.
  *
- * @param vec Reference to vector to look inside of.
- * @param function to call for looking inside the vector. Requires signature
+ * @param items Pointer to the array to look inside of.
+ * @param count Amount of items in the array.
+ * @param function to call for looking inside the array. Requires signature
  * bool(const T&).
  * @param filter to call for comparing found indices. Requires signature
  * bool(const T&, const T&).
@@ -73,14 +310,14 @@ std::ostream &operator<<(std::ostream &os, Tile const &t) {
  */
 template<typename T, typename F, typename C>
 std::pair<bool, size_t>
-find_index_qualified(const std::vector<T> &vec, F function, C filter) {
+find_index_qualified(const T *items, size_t count, F function, C filter) {
   std::pair<bool, size_t> output{false, 0};
 
-  for (size_t i = 0; i < vec.size(); i++) {
+  for (size_t i = 0; i < count; i++) {
     // if the index is valid for this function and the filter determines its
     // more
-    if (function(vec.at(i))) {
-      if (!output.first || filter(vec.at(output.second), vec.at(i))) {
+    if (function(items[i])) {
+      if (!output.first || filter(items[output.second], items[i])) {
         output = std::make_pair(true, i);
       }
     }
@@ -89,45 +326,513 @@ find_index_qualified(const std::vector<T> &vec, F function, C filter) {
   return output;
 }
 
-RummiKub::RummiKub() {}
+const size_t RummiKub::kMaxEncodedSize;
+
+RummiKub::RummiKub() : transposition_bytes(kDefaultTranspositionBytes) {}
+
+RummiKub::RummiKub(Engine engine) :
+    engine(engine), transposition_bytes(kDefaultTranspositionBytes) {}
+
+RummiKub::~RummiKub() { flush_trace(); }
+
+void RummiKub::SetEngine(Engine engine) { this->engine = engine; }
+
+void RummiKub::SetTranspositionTableSize(size_t bytes) {
+  transposition_bytes = bytes;
+}
+
+void RummiKub::SetThreadCount(unsigned threads) { thread_count = threads; }
+
+void RummiKub::SetObjective(Objective objective) {
+  this->objective = objective;
+}
+
+void RummiKub::SetTimeBudget(double seconds) { time_budget = seconds; }
+
+void RummiKub::Add(Tile const &tile) {
+  if (tile.color == Joker) {
+    if (jokers == kMaxJokers) {
+      throw "RummiKub: too many jokers";
+    }
+    jokers++;
+    return;
+  }
+
+  if (tile.denomination < 0 || tile.denomination >= kDenominations) {
+    throw "RummiKub: denomination out of range";
+  }
 
-void RummiKub::Add(Tile const &tile) { tiles.push_back(tile); }
+  if (!hand.add(tile)) {
+    throw "RummiKub: too many copies of a tile";
+  }
+}
 
 void RummiKub::Solve() {
   dbg("Solver Started\n\n");
 
-#if SORT_HAND
-  std::sort(
-      tiles.begin(), tiles.end(), [](const Tile &a, const Tile &b) -> bool {
-        if (a.denomination == b.denomination) {
-          return (a.color < b.color);
-        }
+  // Results from a previous hand must not leak into this one
+  solution.clear();
+  leftover = PackedHand{{0, 0, 0, 0}};
+  leftover_jokers = 0;
+  subset.timed_out = false;
+  if (collect_stats) {
+    stats = SolverStats{};
+  }
 
-        return (a.denomination < b.denomination);
-      });
-  print_vector(tiles);
-#endif
+  if (!(objective == PlayAll ? search(true) : solve_subset())) {
+    leftover = hand;
+    leftover_jokers = jokers;
+  }
 
-  // Setting up the actions (with a level of indirection so that the vtable
-  // is used)
-  std::vector<std::unique_ptr<Action>> actions;
-  actions.push_back(std::unique_ptr<AddToRun>(new AddToRun(runs)));
-  actions.push_back(std::unique_ptr<AddToGroup>(new AddToGroup(groups)));
-  actions.push_back(std::unique_ptr<CreateRun>(new CreateRun(runs)));
-  actions.push_back(std::unique_ptr<CreateGroup>(new CreateGroup(groups)));
+  if (trace_spans.size() >= kTraceFlushSpans) {
+    flush_trace();
+  }
 
-  // Calling the recursive function
-  solver_recurse(0, actions);
-  tiles.clear();
+  if (collect_stats) {
+    stats.nodes = nodes;
+  }
+  hand = PackedHand{{0, 0, 0, 0}};
+  jokers = 0;
 
   print_solution();
 
   dbg("\nSolver terminated\n");
 }
 
-std::vector<std::vector<Tile>> RummiKub::GetGroups() const { return groups; }
+bool RummiKub::IsSolvable() {
+  solution.clear();
+  if (collect_stats) {
+    stats = SolverStats{};
+  }
+  nodes = 0;
+
+#if DECOMPOSE_HAND
+  // search runs the filters
+  bool solvable = search(false);
+#else
+  bool solvable = (jokers > 0 || passes_filters(hand)) && search(false);
+#endif
+
+  if (trace_spans.size() >= kTraceFlushSpans) {
+    flush_trace();
+  }
+
+  if (collect_stats) {
+    stats.nodes = nodes;
+  }
+  hand = PackedHand{{0, 0, 0, 0}};
+  jokers = 0;
+
+  return solvable;
+}
+
+bool RummiKub::search(bool store) {
+#if DECOMPOSE_HAND
+  PackedHand whole = hand;
+  nodes = 0;
+
+  // The filters do not know about jokers, and a joker can join any component
+  if (jokers > 0) {
+    return search_component(store);
+  }
+
+  // Every component fails if the filters fail on it, so this is the first
+  // thing to try
+  if (!passes_filters(whole)) {
+    return false;
+  }
+
+  // The smallest components go first, they are the cheapest to find failing
+  uint64_t components[kDenominations * kColors];
+  int component_count = 0;
+  for (uint64_t left = whole.copies[0]; left != 0;) {
+    uint64_t component = connected_tiles(left, lowest_bit(left));
+    left &= ~component;
+
+    int i = component_count++;
+    for (; i > 0 && popcount(components[i - 1]) > popcount(component); i--) {
+      components[i] = components[i - 1];
+    }
+    components[i] = component;
+  }
+
+  uint64_t whole_nodes = 0;
+  bool solved = true;
+  for (int i = 0; i < component_count && solved; i++) {
+    for (int copy = 0; copy < kMaxCopies; copy++) {
+      hand.copies[copy] = whole.copies[copy] & components[i];
+    }
+    nodes = 0;
+    solved = search_component(store);
+    whole_nodes += nodes;
+  }
+
+  hand = whole;
+  nodes = whole_nodes;
+
+  // The components solved before one that failed stored their sets
+  if (!solved && store) {
+    solution.clear();
+  }
+  return solved;
+#else
+  return search_component(store);
+#endif
+}
+
+bool RummiKub::search_component(bool store) {
+  bool solved = false;
+  switch (engine) {
+    case BruteForce: {
+      ActionSet actions(table);
+      solved = solve_brute_force(actions);
+      break;
+    }
+    case BruteForceVirtual: {
+      // Setting up the actions (with a level of indirection so that the vtable
+      // is used)
+      VirtualActions actions(table);
+      solved = solve_brute_force(actions);
+      break;
+    }
+    case ParallelBruteForce: {
+      PhaseTimer timer(collect_stats, stats.search_seconds);
+      solved = solve_parallel();
+      break;
+    }
+    case BruteForceMostConstrained: {
+      PhaseTimer timer(collect_stats, stats.search_seconds);
+      ActionSet actions(table);
+      solved = solve_most_constrained(actions);
+      break;
+    }
+    // These engines store their play as they rebuild it, and only know about
+    // tiles
+    case DynamicProgramming: {
+      if (jokers > 0) throw "RummiKub: the engine does not play jokers";
+      PhaseTimer timer(collect_stats, stats.search_seconds);
+      return solve_dynamic(store);
+    }
+    case ExactCover: {
+      if (jokers > 0) throw "RummiKub: the engine does not play jokers";
+      PhaseTimer timer(collect_stats, stats.search_seconds);
+      return solve_cover(store);
+    }
+  }
+
+  if (solved && store) {
+    PhaseTimer timer(collect_stats, stats.store_seconds);
+    store_solution();
+  }
+  return solved;
+}
 
-std::vector<std::vector<Tile>> RummiKub::GetRuns() const { return runs; }
+bool RummiKub::passes_filters(const PackedHand &hand) {
+  // A bit steps kColors bits per denomination and stays in its color, and no
+  // bits are above the last denomination, so shifts never mix tiles up
+  uint64_t tiles = hand.copies[0];
+  uint64_t below = tiles << kColors;
+  uint64_t above = tiles >> kColors;
+  uint64_t in_run = (below & (below << kColors)) | (below & above) |
+                    (above & (above >> kColors));
+
+  uint64_t in_group = group_denominations(tiles);
+
+  if (tiles & ~(in_run | in_group)) {
+    return false;
+  }
+
+  auto copies_of = [&hand](int index) {
+    return index >= 0 && index < kDenominations * kColors ? hand.count(index)
+                                                          : 0;
+  };
+
+  // Every copy of a tile needs a set of its own
+  for (uint64_t mask = hand.copies[1]; mask != 0; mask &= mask - 1) {
+    int index = lowest_bit(mask);
+    int first = index - index % kColors;
+
+    // g groups need 3g tiles of different colors, which is at most g of every
+    // color
+    int groups = 0;
+    for (int g = 1; g <= kMaxCopies; g++) {
+      int usable = 0;
+      for (int color = 0; color < kColors; color++) {
+        usable += std::min(hand.count(first + color), g);
+      }
+      if (usable >= 3 * g) groups = g;
+    }
+
+    // A run through the tile has the tile below it or the one above it, and
+    // the one two below or two above when it does not have both
+    int one_below = copies_of(index - kColors);
+    int one_above = copies_of(index + kColors);
+    int runs = std::min(
+        one_below + one_above,
+        std::min(one_below, one_above) +
+            std::min(one_below, copies_of(index - 2 * kColors)) +
+            std::min(one_above, copies_of(index + 2 * kColors)));
+
+    if (hand.count(index) > groups + runs) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void RummiKub::Reset() {
+  hand = PackedHand{{0, 0, 0, 0}};
+  jokers = 0;
+  solution.clear();
+  leftover = PackedHand{{0, 0, 0, 0}};
+  leftover_jokers = 0;
+  subset.timed_out = false;
+  table.clear();
+  nodes = 0;
+}
+
+std::vector<Tile> RummiKub::GetLeftover() const {
+  std::vector<Tile> tiles;
+  for (int index = 0; index < kColors * kDenominations; index++) {
+    for (int copy = leftover.count(index); copy > 0; copy--) {
+      tiles.push_back(PackedHand::tile(index));
+    }
+  }
+  for (int joker = 0; joker < leftover_jokers; joker++) {
+    tiles.push_back(Tile{0, Joker});
+  }
+  return tiles;
+}
+
+bool RummiKub::TimedOut() const { return subset.timed_out; }
+
+uint64_t RummiKub::GetNodeCount() const { return nodes; }
+
+void RummiKub::SetStatsEnabled(bool enabled) {
+  collect_stats = enabled;
+  if (!enabled) {
+    stats = SolverStats{};
+  }
+}
+
+const SolverStats &RummiKub::GetStats() const { return stats; }
+
+const unsigned RummiKub::kDefaultTraceInterval;
+
+void RummiKub::SetTrace(std::ostream *out, unsigned sample_interval) {
+  flush_trace();
+
+  trace_out = out;
+  trace_interval = sample_interval != 0 ? sample_interval : 1;
+  trace_countdown = out != nullptr ? trace_interval : 0;
+  trace_origin = std::chrono::steady_clock::now();
+
+  if (out != nullptr) {
+    // Reserved up front so that the search does not allocate
+    trace_spans.reserve(kTraceFlushSpans);
+    *out << "[\n";
+  }
+}
+
+void RummiKub::flush_trace() {
+  if (trace_out == nullptr || trace_spans.empty()) {
+    return;
+  }
+
+  // The trace is in microseconds. The times are printed as integers, which
+  // snprintf does about twice as fast as doubles.
+  char line[160];
+  for (const TraceSpan &span: trace_spans) {
+    int size = std::snprintf(
+        line,
+        sizeof(line),
+        "{\"name\":\"%s\",\"cat\":\"search\",\"ph\":\"X\","
+        "\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"pid\":0,\"tid\":%u,"
+        "\"args\":{\"depth\":%u}},\n",
+        kActionNames[span.action],
+        static_cast<unsigned long long>(span.start / 1000),
+        static_cast<unsigned>(span.start % 1000),
+        static_cast<unsigned long long>(span.duration / 1000),
+        static_cast<unsigned>(span.duration % 1000),
+        static_cast<unsigned>(span.thread),
+        static_cast<unsigned>(span.depth));
+    trace_out->write(line, size);
+  }
+  trace_out->flush();
+
+  trace_spans.clear();
+}
+
+template<typename Actions>
+bool RummiKub::solve_brute_force(Actions &actions) {
+  {
+    PhaseTimer timer(collect_stats, stats.setup_seconds);
+    actions.reset();
+    prepare_brute_force();
+  }
+
+  // Calling the recursive function
+  PhaseTimer timer(collect_stats, stats.search_seconds);
+  return solver_recurse(hand, -1, 0, actions);
+}
+
+void RummiKub::prepare_brute_force() {
+  nodes = 0;
+  table.clear();
+  hand_size = tile_count(hand);
+  // A tile and two jokers make a set
+  table.set_limit = static_cast<uint8_t>((hand_size + jokers) / 3);
+  // A joker fills the gap between a run and a tile, two of them a gap of 2
+  table.reach = static_cast<uint8_t>(1 + jokers);
+
+#if TRANSPOSITION_TABLE
+  // The keys leave out what the sets that no longer change need from the
+  // jokers
+  use_transpositions = hand_size >= kTranspositionMinHand && jokers == 0;
+  if (use_transpositions) {
+    // Keeping a power of 2 buckets so that the index is a mask of the hash
+    size_t buckets = transposition_bytes / sizeof(TranspositionBucket);
+    while (buckets & (buckets - 1)) buckets &= buckets - 1;
+    if (transpositions.size() != buckets) {
+      transpositions.assign(buckets, TranspositionBucket{});
+      generation = 0;
+    }
+
+    // Entries of previous hands are told apart by their generation
+    if (++generation == 0) {
+      transpositions.assign(buckets, TranspositionBucket{});
+      generation = 1;
+    }
+  }
+#endif
+}
+
+std::vector<std::vector<Tile>> RummiKub::GetGroups() const {
+  std::vector<std::vector<Tile>> groups;
+  groups.reserve(solution.group_count);
+  for (int i = 0; i < solution.group_count; i++) {
+    groups.emplace_back(solution.group_begin(i), solution.group_end(i));
+  }
+  return groups;
+}
+
+std::vector<std::vector<Tile>> RummiKub::GetRuns() const {
+  std::vector<std::vector<Tile>> runs;
+  runs.reserve(solution.run_count);
+  for (int i = 0; i < solution.run_count; i++) {
+    runs.emplace_back(solution.run_begin(i), solution.run_end(i));
+  }
+  return runs;
+}
+
+size_t RummiKub::GetRunCount() const { return solution.run_count; }
+
+TileRange RummiKub::GetRun(size_t index) const {
+  int run = static_cast<int>(index);
+  return TileRange{solution.run_begin(run), solution.run_end(run)};
+}
+
+size_t RummiKub::GetGroupCount() const { return solution.group_count; }
+
+TileRange RummiKub::GetGroup(size_t index) const {
+  int group = static_cast<int>(index);
+  return TileRange{solution.group_begin(group), solution.group_end(group)};
+}
+
+size_t RummiKub::EncodeSolution(uint8_t *buffer) const {
+  uint8_t *out = buffer;
+  *out++ = solution.run_count;
+  *out++ = solution.group_count;
+
+  for (size_t i = 0; i < GetRunCount() + GetGroupCount(); i++) {
+    TileRange set = i < GetRunCount() ? GetRun(i) : GetGroup(i - GetRunCount());
+    *out++ = static_cast<uint8_t>(set.size());
+    for (const Tile &tile: set) {
+      *out++ = static_cast<uint8_t>(
+          tile.color == Joker ? kColors * kDenominations + tile.denomination
+                              : PackedHand::bit_index(tile));
+    }
+  }
+
+  return static_cast<size_t>(out - buffer);
+}
+
+void RummiKub::DecodeSolution(
+    const uint8_t *buffer,
+    size_t size,
+    std::vector<std::vector<Tile>> &runs,
+    std::vector<std::vector<Tile>> &groups) {
+  runs.clear();
+  groups.clear();
+  if (size < 2) {
+    throw "RummiKub: encoded solution is too short";
+  }
+
+  const uint8_t *in = buffer + 2;
+  const uint8_t *end = buffer + size;
+  for (int i = 0; i < buffer[0] + buffer[1]; i++) {
+    std::vector<std::vector<Tile>> &sets = i < buffer[0] ? runs : groups;
+    if (in == end || end - in <= *in) {
+      throw "RummiKub: encoded solution is too short";
+    }
+
+    sets.emplace_back();
+    for (int tiles = *in++; tiles > 0; tiles--) {
+      int value = *in++;
+      if (value < kColors * kDenominations) {
+        sets.back().push_back(PackedHand::tile(value));
+      } else if (value < (kColors + 1) * kDenominations) {
+        sets.back().push_back(Tile{value - kColors * kDenominations, Joker});
+      } else {
+        throw "RummiKub: encoded tile out of range";
+      }
+    }
+  }
+}
+
+void SolverStats::add(const SolverStats &other) {
+  nodes += other.nodes;
+  leaves += other.leaves;
+  for (int i = 0; i < kActions; i++) {
+    executed[i] += other.executed[i];
+    rejected[i] += other.rejected[i];
+  }
+  pruned += other.pruned;
+  backtracks += other.backtracks;
+  transposition_hits += other.transposition_hits;
+  if (other.max_depth > max_depth) max_depth = other.max_depth;
+  for (int depth = 0; depth <= kMaxTiles; depth++) {
+    depth_nodes[depth] += other.depth_nodes[depth];
+    depth_children[depth] += other.depth_children[depth];
+  }
+  setup_seconds += other.setup_seconds;
+  search_seconds += other.search_seconds;
+  store_seconds += other.store_seconds;
+}
+
+std::ostream &operator<<(std::ostream &os, SolverStats const &stats) {
+  os << "nodes " << stats.nodes << ", leaves " << stats.leaves
+     << ", pruned " << stats.pruned << ", backtracks " << stats.backtracks
+     << ", transposition hits " << stats.transposition_hits
+     << ", max depth " << stats.max_depth << "\n";
+  for (int i = 0; i < SolverStats::kActions; i++) {
+    os << kActionNames[i] << ": " << stats.executed[i] << " executed, "
+       << stats.rejected[i] << " rejected\n";
+  }
+
+  os << "branching:";
+  for (int depth = 0; depth <= stats.max_depth; depth++) {
+    if (stats.depth_nodes[depth] == 0) continue;
+    os << " " << depth << ":"
+       << static_cast<double>(stats.depth_children[depth]) /
+              static_cast<double>(stats.depth_nodes[depth]);
+  }
+
+  os << "\nseconds: setup " << stats.setup_seconds << ", search "
+     << stats.search_seconds << ", store " << stats.store_seconds << "\n";
+  return os;
+}
 
 void RummiKub::print_solution() {
   print_runs();
@@ -137,214 +842,851 @@ void RummiKub::print_solution() {
 bool RummiKub::validate_solution() {
   dbg("Validating Solution start\n");
 
-  for (std::vector<Tile> &run: runs) {
-    if (!validate_run(run)) {
-      dbg("Validating solution end: failed\n\n");
-      return false;
-    }
+  if (jokers > 0) {
+    return place_jokers(nullptr, nullptr);
   }
 
-  for (std::vector<Tile> &group: groups) {
-    if (!validate_group(group)) {
-      dbg("Validating solution end: failed\n\n");
-      return false;
-    }
+  if (table.deficient != 0) {
+    dbg("Validating solution end: failed\n\n");
+    return false;
   }
 
   dbg("Validating solution end: success\n\n");
   return true;
 }
 
+bool RummiKub::place_jokers(uint16_t *run_fills, uint8_t *group_fills) const {
+  int used = 0;
+  int room = 0;
+
+  for (uint8_t i = 0; i < table.run_count; i++) {
+    unsigned mask = table.runs[i].denominations;
+    unsigned fill = 0;
+    int needed = RunRule(mask).legal() ? 0 : run_jokers(mask, 0, &fill);
+    used += needed;
+    if (used > jokers) return false;
+
+    room += kDenominations - popcount(mask | fill);
+    if (run_fills != nullptr) run_fills[i] = static_cast<uint16_t>(fill);
+  }
+
+  for (uint8_t i = 0; i < table.group_count; i++) {
+    int needed = GroupRule(table.groups[i].colors).needed();
+    used += needed;
+    if (used > jokers) return false;
+
+    room += kColors - popcount(table.groups[i].colors) - needed;
+    if (group_fills != nullptr) group_fills[i] = static_cast<uint8_t>(needed);
+  }
+
+  // A joker next to a legal sequence or in a group with a color missing
+  // keeps the set legal
+  int left = jokers - used;
+  if (left > room) return false;
+  if (run_fills == nullptr) return true;
+
+  const unsigned kAllDenominations = (1u << kDenominations) - 1;
+  for (uint8_t i = 0; i < table.run_count && left > 0; i++) {
+    for (; left > 0; left--) {
+      unsigned played = table.runs[i].denominations | run_fills[i];
+      unsigned next = ((played << 1) | (played >> 1)) & ~played &
+                      kAllDenominations;
+      if (next == 0) break;
+      run_fills[i] = static_cast<uint16_t>(run_fills[i] | (next & -next));
+    }
+  }
+
+  for (uint8_t i = 0; i < table.group_count && left > 0; i++) {
+    int free = kColors - popcount(table.groups[i].colors) - group_fills[i];
+    int added = std::min(free, left);
+    group_fills[i] = static_cast<uint8_t>(group_fills[i] + added);
+    left -= added;
+  }
+
+  return true;
+}
+
+void RummiKub::store_solution() {
+  uint16_t run_fills[kMaxSets] = {};
+  uint8_t group_fills[kMaxSets] = {};
+  if (jokers > 0) {
+    place_jokers(run_fills, group_fills);
+  }
+
+  for (uint8_t i = 0; i < table.run_count; i++) {
+    const Run &run = table.runs[i];
+    unsigned played = run.denominations | run_fills[i];
+
+    // A gap the jokers left open splits the run into sequences
+    for (int start = 0; played >> start; start++) {
+      if (!((played >> start) & 1)) continue;
+      int end = start;
+      while ((played >> end) & 1) end++;
+
+      Tile *tiles = solution.add_run(end - start);
+      for (; start < end; start++) {
+        *tiles++ = run.denominations & (1u << start)
+                       ? Tile{start, static_cast<Color>(run.color)}
+                       : Tile{start, Joker};
+      }
+    }
+  }
+
+  for (uint8_t i = 0; i < table.group_count; i++) {
+    const Group &group = table.groups[i];
+    Tile *tiles = solution.add_group(popcount(group.colors) + group_fills[i]);
+    for (int color = 0; color < kColors; color++) {
+      if (group.colors & (1u << color)) {
+        *tiles++ = Tile{group.denomination, static_cast<Color>(color)};
+      }
+    }
+    for (int joker = 0; joker < group_fills[i]; joker++) {
+      *tiles++ = Tile{group.denomination, Joker};
+    }
+  }
+}
+
+template<typename Actions>
 bool RummiKub::solver_recurse(
-    size_t current_tile, std::vector<std::unique_ptr<Action>> &actions) {
-  if (current_tile == tiles.size()) {
+    PackedHand remaining,
+    int last_tile,
+    size_t last_action,
+    Actions &actions) {
+  nodes++;
+
+  int depth = 0;
+  if (collect_stats) {
+    depth = hand_size - tile_count(remaining);
+    stats.depth_nodes[depth]++;
+    if (depth > stats.max_depth) stats.max_depth = depth;
+  }
+
+  if (remaining.empty()) {
+    if (collect_stats) stats.leaves++;
     return validate_solution();
   }
 
+  // Another thread found a play
+  if (cancelled != nullptr && cancelled->load(std::memory_order_relaxed)) {
+    return false;
+  }
+
+  // The lowest bit is the next tile of the sorted hand
+  int index = lowest_bit(remaining.copies[0]);
+  size_t first_action = index == last_tile ? last_action : 0;
+
+#if TRANSPOSITION_TABLE
+  Transposition key;
+  bool keyed = transposition_key(remaining, index, first_action, key);
+  if (keyed && transposition_failed(key)) {
+    if (collect_stats) stats.transposition_hits++;
+    return false;
+  }
+#endif
+
+  Tile tile = PackedHand::tile(index);
+  remaining.remove(index);
+
   // Checking all possible actions with the tile
-  for (std::unique_ptr<Action> &action: actions) {
-    bool success = action->execute(tiles.at(current_tile));
+  for (size_t i = first_action; i < actions.size(); i++) {
+    bool success = actions.execute(i, tile);
+    if (collect_stats) (success ? stats.executed : stats.rejected)[i]++;
     if (!success) continue;
 
+#if FORWARD_CHECK
+    if (!completable(remaining)) {
+      if (collect_stats) stats.pruned++;
+      actions.revert(i, tile);
+      continue;
+    }
+#endif
+
     // If the action could be performed, recurse
-    bool recursive_success = solver_recurse(current_tile + 1, actions);
+    if (collect_stats) stats.depth_children[depth]++;
+    bool recursive_success =
+        trace_countdown != 0 && --trace_countdown == 0
+            ? traced_recurse(remaining, index, i, actions)
+            : solver_recurse(remaining, index, i, actions);
     if (recursive_success) {
       return true;
     }
 
     // Backtracking
-    action->revert(tiles.at(current_tile));
+    if (collect_stats) stats.backtracks++;
+    actions.revert(i, tile);
+  }
+
+#if TRANSPOSITION_TABLE
+  // A subtree cut short by another thread did not fail
+  if (keyed && (cancelled == nullptr ||
+                !cancelled->load(std::memory_order_relaxed))) {
+    transposition_store(key);
+  }
+#endif
+
+  return false;
+}
+
+template<typename Actions>
+bool RummiKub::traced_recurse(
+    const PackedHand &remaining,
+    int index,
+    size_t action,
+    Actions &actions) {
+  // Counting again from here, so that the subtree is sampled too
+  trace_countdown = trace_interval;
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  bool success = solver_recurse(remaining, index, action, actions);
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  trace_spans.push_back(TraceSpan{
+      nanoseconds(start - trace_origin),
+      nanoseconds(end - start),
+      static_cast<uint16_t>(hand_size - tile_count(remaining)),
+      trace_thread,
+      static_cast<uint8_t>(action)});
+  return success;
+}
+
+template<typename Actions>
+void RummiKub::split_search(
+    PackedHand remaining,
+    int last_tile,
+    size_t last_action,
+    int depth,
+    Actions &actions,
+    std::vector<SearchTask> &tasks) {
+  nodes++;
+
+  if (depth == 0 || remaining.empty()) {
+    tasks.push_back(SearchTask{table, remaining, last_tile, last_action});
+    return;
+  }
+
+  // Same order and pruning as solver_recurse
+  int index = lowest_bit(remaining.copies[0]);
+  size_t first_action = index == last_tile ? last_action : 0;
+  Tile tile = PackedHand::tile(index);
+  remaining.remove(index);
+
+  for (size_t i = first_action; i < actions.size(); i++) {
+    if (!actions.execute(i, tile)) continue;
+
+    bool viable = true;
+#if FORWARD_CHECK
+    viable = completable(remaining);
+#endif
+    if (viable) {
+      split_search(remaining, index, i, depth - 1, actions, tasks);
+    }
+
+    actions.revert(i, tile);
+  }
+}
+
+bool RummiKub::solve_subset() {
+  if (jokers > 0) {
+    throw "RummiKub: the objective does not play jokers";
+  }
+
+  if (time_budget > 0) {
+    subset.deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(time_budget));
+  }
+
+  // A tile no set of the hand can take stays in the hand whatever the rest
+  // does, and every set is made of the other tiles, so leaving these out
+  // first keeps the components small
+  uint64_t playable = run_windows(hand.copies[0]) |
+                      (hand.copies[0] & group_denominations(hand.copies[0]));
+  for (int copy = 0; copy < kMaxCopies; copy++) {
+    leftover.copies[copy] = hand.copies[copy] & ~playable;
+  }
+
+  PackedHand whole = hand;
+  uint64_t whole_nodes = 0;
+  ActionSet actions(table);
+  for (uint64_t left = playable; left != 0;) {
+    uint64_t component = connected_tiles(left, lowest_bit(left));
+    left &= ~component;
+
+    subset.limit = 0;
+    for (int copy = 0; copy < kMaxCopies; copy++) {
+      hand.copies[copy] = whole.copies[copy] & component;
+      subset.limit += subset_value(hand.copies[copy]);
+    }
+
+    // The transposition table remembers the value a state can add instead of
+    // its failure, under a generation of its own
+    actions.reset();
+    prepare_brute_force();
+
+    // Until a better play is found the whole component stays in the hand
+    subset.placed = 0;
+    subset.best = 0;
+    subset.left = PackedHand{{0, 0, 0, 0}};
+    subset.best_left = hand;
+    subset.found = false;
+    subset.base_runs = solution.run_count;
+    subset.base_groups = solution.group_count;
+    subset_recurse(hand, -1, 0, actions);
+    whole_nodes += nodes;
+
+    for (int copy = 0; copy < kMaxCopies; copy++) {
+      leftover.copies[copy] |= subset.best_left.copies[copy];
+    }
+  }
+
+  hand = whole;
+  nodes = whole_nodes;
+  return true;
+}
+
+int RummiKub::subset_value(uint64_t tiles) const {
+  if (objective != MostPoints) {
+    return popcount(tiles);
+  }
+
+  int value = 0;
+  for (int bit = 0; bit < 4; bit++) {
+    value += popcount(tiles & points_plane(bit)) << bit;
+  }
+  return value;
+}
+
+int RummiKub::subset_bound(const PackedHand &remaining) const {
+  uint64_t tiles = remaining.copies[0];
+  int lowest = lowest_bit(tiles) / kColors;
+
+  // A run only grows through its top 2 tiles, and only when its top is right
+  // under the tiles left. Only the groups of the lowest denomination left can
+  // still grow.
+  uint64_t sequences = tiles;
+  for (uint8_t i = 0; i < table.run_count; i++) {
+    const Run &run = table.runs[i];
+    int top = RunRule(run.denominations).top();
+    if (top + 1 < lowest) continue;
+
+    sequences |= uint64_t{1} << (top * kColors + run.color);
+    if (top > 0 && ((run.denominations >> (top - 1)) & 1)) {
+      sequences |= uint64_t{1} << ((top - 1) * kColors + run.color);
+    }
+  }
+
+  uint64_t colors = tiles;
+  for (uint8_t i = 0; i < table.group_count; i++) {
+    const Group &group = table.groups[i];
+    if (group.denomination == lowest) {
+      colors |= uint64_t{group.colors} << (lowest * kColors);
+    }
+  }
+
+  uint64_t reachable =
+      tiles & (run_windows(sequences) | group_denominations(colors));
+  int bound = 0;
+  for (uint64_t copy: remaining.copies) {
+    bound += subset_value(copy & reachable);
+  }
+  return bound;
+}
+
+bool RummiKub::subset_recurse(
+    PackedHand remaining,
+    int last_tile,
+    size_t last_action,
+    ActionSet &actions) {
+  nodes++;
+
+  if (time_budget > 0 && (nodes & kSubsetClockMask) == 0 &&
+      std::chrono::steady_clock::now() > subset.deadline) {
+    subset.timed_out = true;
+  }
+  // Out of time, a component still gets the first play the search reaches
+  if (subset.timed_out && subset.found) {
+    return true;
+  }
+
+  if (remaining.empty()) {
+    subset.found = subset.found || table.deficient == 0;
+    if (table.deficient == 0 && subset.placed > subset.best) {
+      subset.best = subset.placed;
+      subset.best_left = subset.left;
+
+      // Replacing the play of this component stored before
+      solution.run_count = subset.base_runs;
+      solution.group_count = subset.base_groups;
+      store_solution();
+    }
+    return subset.best == subset.limit || subset.timed_out;
+  }
+
+  if (subset.placed + subset_bound(remaining) <= subset.best) {
+    return false;
+  }
+
+  // Same order and copy symmetry as solver_recurse, leaving the tile in the
+  // hand is the last action
+  int index = lowest_bit(remaining.copies[0]);
+  size_t first_action = index == last_tile ? last_action : 0;
+
+#if TRANSPOSITION_TABLE
+  Transposition key;
+  bool keyed = transposition_key(remaining, index, first_action, key);
+  if (keyed) {
+    const Transposition *entry = transposition_find(key);
+    if (entry != nullptr && subset.placed + entry->value <= subset.best) {
+      if (collect_stats) stats.transposition_hits++;
+      return false;
+    }
+  }
+#endif
+
+  Tile tile = PackedHand::tile(index);
+  remaining.remove(index);
+  int value = subset_value(uint64_t{1} << index);
+
+  for (size_t i = first_action; i < actions.size(); i++) {
+    if (!actions.execute(i, tile)) continue;
+
+    if (completable(remaining)) {
+      subset.placed += value;
+      bool stop = subset_recurse(remaining, index, i, actions);
+      subset.placed -= value;
+      if (stop) return true;
+    }
+
+    actions.revert(i, tile);
+  }
+
+  // The sets on the table may still need the tile
+  if (completable(remaining)) {
+    subset.left.add(tile);
+    if (subset_recurse(remaining, index, actions.size(), actions)) {
+      return true;
+    }
+    subset.left.remove(index);
+  }
+
+#if TRANSPOSITION_TABLE
+  // Every play under this state was found, or cut for not beating the best
+  if (keyed) {
+    key.value = subset.best - subset.placed;
+    transposition_store(key);
   }
+#endif
 
   return false;
 }
 
+bool RummiKub::transposition_key(
+    const PackedHand &remaining,
+    int next_tile,
+    size_t first_action,
+    Transposition &key) const {
+  if (!use_transpositions || transpositions.empty()) {
+    return false;
+  }
+
+  int tiles_left = 0;
+  for (uint64_t copy: remaining.copies) tiles_left += popcount(copy);
+  if (tiles_left < kTranspositionMinTiles) {
+    return false;
+  }
+
+  int denomination = next_tile / kColors;
+  int next_color = next_tile % kColors;
+
+  // [color][ends at the previous/current denomination][1, 2 or 3+ tiles]
+  int run_counts[kColors][2][3] = {};
+  for (uint8_t i = 0; i < table.run_count; i++) {
+    const Run &run = table.runs[i];
+    SetRule rule = RunRule(run.denominations);
+    int top = rule.top();
+
+    // The colors before the next tile have no more tiles of this denomination
+    int end = top - (denomination - 1);
+    if (end < 0 || (end == 0 && run.color < next_color)) continue;
+
+    // The tiles of the sequence ending at the top, up to 3
+    int length = 3 - rule.needed();
+
+    if (++run_counts[run.color][end][length - 1] > 4) {
+      return false;
+    }
+  }
+
+  key.runs = static_cast<uint64_t>(first_action) << (kColors * 14);
+  for (int color = 0; color < kColors; color++) {
+    for (int end = 0; end < 2; end++) {
+      const int *counts = run_counts[color][end];
+      uint64_t code =
+          static_cast<uint64_t>(counts[0] + 5 * counts[1] + 25 * counts[2]);
+      key.runs |= code << (color * 14 + end * 7);
+    }
+  }
+
+  // Insertion sort of the open groups
+  uint8_t masks[kMaxOpenGroups];
+  int open = 0;
+  for (uint8_t i = 0; i < table.group_count; i++) {
+    const Group &group = table.groups[i];
+    if (group.denomination != denomination) continue;
+    if (open == kMaxOpenGroups) {
+      return false;
+    }
+
+    int position = open++;
+    while (position > 0 && masks[position - 1] > group.colors) {
+      masks[position] = masks[position - 1];
+      position--;
+    }
+    masks[position] = group.colors;
+  }
+
+  key.groups = 0;
+  for (int i = 0; i < open; i++) {
+    key.groups |= static_cast<uint64_t>(masks[i]) << (i * 4);
+  }
+  key.groups |= static_cast<uint64_t>(tiles_left) << 48;
+  key.groups |= static_cast<uint64_t>(table.run_count + table.group_count)
+                << 56;
+  key.generation = generation;
+  key.value = 0;
+  return true;
+}
+
+/**
+ * @brief Bucket of a transposition key.
+ *
+ * @param runs The runs word of the key.
+ * @param groups The groups word of the key.
+ * @param buckets The amount of buckets (a power of 2).
+ * @return The index of the bucket.
+ */
+inline size_t
+transposition_index(uint64_t runs, uint64_t groups, size_t buckets) {
+  uint64_t hash = (runs ^ (groups * 0x9E3779B97F4A7C15ull)) *
+                  0xBF58476D1CE4E5B9ull;
+  return static_cast<size_t>(hash ^ (hash >> 31)) & (buckets - 1);
+}
+
+const RummiKub::Transposition *
+RummiKub::transposition_find(const Transposition &key) const {
+  const TranspositionBucket &bucket = transpositions[transposition_index(
+      key.runs, key.groups, transpositions.size())];
+
+  for (const Transposition *entry: {&bucket.deepest, &bucket.newest}) {
+    if (entry->runs == key.runs && entry->groups == key.groups &&
+        entry->generation == key.generation) {
+      return entry;
+    }
+  }
+
+  return nullptr;
+}
+
+void RummiKub::transposition_store(const Transposition &key) {
+  TranspositionBucket &bucket = transpositions[transposition_index(
+      key.runs, key.groups, transpositions.size())];
+
+  // The amount of tiles left is the top bits of the groups word, right under
+  // the amount of sets
+  uint64_t deepest_tiles = (bucket.deepest.groups >> 48) & 0xFF;
+  uint64_t key_tiles = (key.groups >> 48) & 0xFF;
+  if (bucket.deepest.generation != key.generation ||
+      deepest_tiles <= key_tiles) {
+    bucket.deepest = key;
+  } else {
+    bucket.newest = key;
+  }
+}
+
+bool RummiKub::completable(const PackedHand &remaining) const {
+  if (table.deficient == 0) {
+    return true;
+  }
+  if (jokers > 0) {
+    return completable_with_jokers(remaining);
+  }
+
+  uint64_t available = remaining.copies[0];
+
+  // The tiles right above the highest one of a run, for every amount needed
+  const uint64_t kNeededTiles[] = {0x0, 0x1, 0x11, 0x111};
+
+  for (uint8_t i = 0; i < table.run_count; i++) {
+    const Run &run = table.runs[i];
+    SetRule rule = RunRule(run.denominations);
+    if (rule.legal()) continue;
+    if (!rule.completable()) return false;
+
+    uint64_t needed = kNeededTiles[rule.needed()]
+                      << ((rule.top() + 1) * kColors + run.color);
+    if ((available & needed) != needed) {
+      return false;
+    }
+  }
+
+  for (uint8_t i = 0; i < table.group_count; i++) {
+    const Group &group = table.groups[i];
+    SetRule rule = GroupRule(group.colors);
+    if (rule.legal()) continue;
+
+    uint64_t colors = (available >> (group.denomination * kColors)) & 0xF;
+    if (popcount(colors & ~group.colors) < rule.needed()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool RummiKub::completable_with_jokers(const PackedHand &remaining) const {
+  const uint64_t kNeededTiles[] = {0x0, 0x1, 0x11, 0x111};
+  uint64_t available = remaining.copies[0];
+  int needed = 0;
+
+  for (uint8_t i = 0; i < table.run_count; i++) {
+    const Run &run = table.runs[i];
+    SetRule rule = RunRule(run.denominations);
+    if (rule.legal()) continue;
+
+    // The tiles left complete it as they would without jokers
+    if (rule.completable()) {
+      uint64_t tiles = kNeededTiles[rule.needed()]
+                       << ((rule.top() + 1) * kColors + run.color);
+      if ((available & tiles) == tiles) continue;
+    }
+
+    // Every tile left of the color counts as free, it may go elsewhere but
+    // this keeps the bound below the jokers really needed
+    needed += run_jokers(
+        run.denominations,
+        color_denominations(available, run.color),
+        nullptr);
+    if (needed > jokers) return false;
+  }
+
+  for (uint8_t i = 0; i < table.group_count; i++) {
+    const Group &group = table.groups[i];
+    SetRule rule = GroupRule(group.colors);
+    if (rule.legal()) continue;
+
+    uint64_t colors = (available >> (group.denomination * kColors)) & 0xF;
+    int missing = rule.needed() - popcount(colors & ~group.colors);
+    if (missing > 0) needed += missing;
+    if (needed > jokers) return false;
+  }
+
+  return true;
+}
+
 RummiKub::Action::~Action() = default;
 
-RummiKub::AddToRun::AddToRun(std::vector<std::vector<Tile>> &runs) :
-    runs(runs) {}
+RummiKub::AddToRun::AddToRun(Table &table) : table(table) {}
 
 bool RummiKub::AddToRun::execute(const Tile &tile) {
+  uint16_t bit = static_cast<uint16_t>(1u << tile.denomination);
+  // The denominations within reach of the tile on both sides
+  unsigned span = (2u << (2 * table.reach)) - 1;
+  uint16_t neighbours = static_cast<uint16_t>(
+      ((span << tile.denomination) >> table.reach) & ~bit);
+
+  const Run *runs = table.runs;
   std::pair<bool, size_t> color_index = find_index_qualified(
-      runs,
-      [tile](const std::vector<Tile> &run) -> bool {
-        // Check if the tile is the right color
-        if (run.empty() || (run.at(0).color != tile.color)) {
-          return false;
-        };
-
-        // Check if the tile is already in the run and if it is in sequence to
-        // another
-        bool is_sequence{false};
-        for (const Tile &current_tile: run) {
-          if (tile.denomination == current_tile.denomination) {
-            return false;
-          }
-
-          if (((tile.denomination + 1) == current_tile.denomination) ||
-              (tile.denomination == (current_tile.denomination + 1))) {
-            is_sequence = true;
-          }
+      table.color_runs[tile.color],
+      table.color_run_count[tile.color],
+      [runs, bit, neighbours](uint8_t index) -> bool {
+        // Check if the tile is not already in the run and is in sequence to
+        // another (the index only holds runs of the tile's color)
+        const Run &run = runs[index];
+        return !(run.denominations & bit) && (run.denominations & neighbours);
+      },
+      [runs, bit](uint8_t min, uint8_t current) -> bool {
+        // The runs grow upwards, so the denominations under the tile tell how
+        // close a run gets to it: the closest one needs the fewest jokers
+        unsigned current_below = runs[current].denominations & (bit - 1u);
+        unsigned min_below = runs[min].denominations & (bit - 1u);
+        if ((current_below ^ min_below) > (current_below & min_below)) {
+          return current_below > min_below;
         }
 
-        return is_sequence;
-      },
-      [](const std::vector<Tile> &max,
-         const std::vector<Tile> &current) -> bool {
         // making sure that it is the smallest possible run to add to
-        return current.size() < max.size();
+        return popcount(runs[current].denominations) <
+               popcount(runs[min].denominations);
       });
 
   if (not color_index.first) {
     return false;
   }
 
-  std::vector<Tile> &run = runs.at(color_index.second);
-  run.push_back(tile);
-  inserts.push_back(color_index.second);
+  uint8_t index = table.color_runs[tile.color][color_index.second];
+  Run &run = table.runs[index];
+  table.deficient -= deficiency(validate_run(run));
+  run.denominations = static_cast<uint16_t>(run.denominations | bit);
+  table.deficient += deficiency(validate_run(run));
+  inserts[insert_count++] = index;
   return true;
 }
 
-void RummiKub::AddToRun::revert(const Tile &) {
-  runs.at(inserts.back()).pop_back();
-  inserts.pop_back();
+void RummiKub::AddToRun::revert(const Tile &tile) {
+  Run &run = table.runs[inserts[--insert_count]];
+  table.deficient -= deficiency(validate_run(run));
+  run.denominations =
+      static_cast<uint16_t>(run.denominations & ~(1u << tile.denomination));
+  table.deficient += deficiency(validate_run(run));
 }
 
-RummiKub::AddToGroup::AddToGroup(std::vector<std::vector<Tile>> &groups) :
-    groups(groups) {}
+RummiKub::AddToGroup::AddToGroup(Table &table) : table(table) {}
 
 bool RummiKub::AddToGroup::execute(const Tile &tile) {
-  std::pair<bool, size_t> denom_index = find_index_qualified(
-      groups,
-      [tile](const std::vector<Tile> &group) -> bool {
-        // Check if the tile is the right denomination
-        if (group.empty() || (group.at(0).denomination != tile.denomination) ||
-            group.size() == 4) {
-          return false;
-        };
-
-        // Check if the color is already in the run
-        for (const Tile &current_tile: group) {
-          if (tile.color == current_tile.color) {
-            return false;
-          }
-        }
+  uint8_t bit = static_cast<uint8_t>(1u << tile.color);
 
-        return true;
+  const Group *groups = table.groups;
+  std::pair<bool, size_t> denom_index = find_index_qualified(
+      table.denomination_groups[tile.denomination],
+      table.denomination_group_count[tile.denomination],
+      [groups, bit](uint8_t index) -> bool {
+        // Check if the color is already in the group (a full group has every
+        // color, and the index only holds groups of the tile's denomination)
+        return !(groups[index].colors & bit);
       },
-      [](const std::vector<Tile> &max,
-         const std::vector<Tile> &current) -> bool {
+      [groups](uint8_t min, uint8_t current) -> bool {
         // making sure that it is the smallest possible group to add to
-        return current.size() < max.size();
+        return popcount(groups[current].colors) <
+               popcount(groups[min].colors);
       });
 
   if (denom_index.first) {
-    groups.at(denom_index.second).push_back(tile);
-    inserts.push_back(denom_index.second);
+    uint8_t index =
+        table.denomination_groups[tile.denomination][denom_index.second];
+    Group &group = table.groups[index];
+    table.deficient -= deficiency(validate_group(group));
+    group.colors = static_cast<uint8_t>(group.colors | bit);
+    table.deficient += deficiency(validate_group(group));
+    inserts[insert_count++] = index;
     return true;
   }
 
   return false;
 }
 
-void RummiKub::AddToGroup::revert(const Tile &) {
-  groups.at(inserts.back()).pop_back();
-  inserts.pop_back();
+void RummiKub::AddToGroup::revert(const Tile &tile) {
+  Group &group = table.groups[inserts[--insert_count]];
+  table.deficient -= deficiency(validate_group(group));
+  group.colors = static_cast<uint8_t>(group.colors & ~(1u << tile.color));
+  table.deficient += deficiency(validate_group(group));
 }
 
-RummiKub::CreateRun::CreateRun(std::vector<std::vector<Tile>> &runs) :
-    runs(runs) {}
+RummiKub::CreateRun::CreateRun(Table &table) : table(table) {}
 
 bool RummiKub::CreateRun::execute(const Tile &tile) {
-  runs.emplace_back();
-  runs.back().push_back(tile);
+  if (table.full()) {
+    return false;
+  }
+
+  // A run of a single tile is never legal
+  uint8_t &color_count = table.color_run_count[tile.color];
+  table.color_runs[tile.color][color_count++] = table.run_count;
+  Run &run = table.runs[table.run_count++];
+  run.denominations = static_cast<uint16_t>(1u << tile.denomination);
+  run.color = static_cast<uint8_t>(tile.color);
+  table.deficient++;
   return true;
 }
 
-void RummiKub::CreateRun::revert(const Tile &) { runs.pop_back(); }
+void RummiKub::CreateRun::revert(const Tile &tile) {
+  // The run created last is also the last one of its color
+  table.color_run_count[tile.color]--;
+  table.run_count--;
+  table.deficient--;
+}
 
-RummiKub::CreateGroup::CreateGroup(std::vector<std::vector<Tile>> &groups) :
-    groups(groups) {}
+RummiKub::CreateGroup::CreateGroup(Table &table) : table(table) {}
 
 bool RummiKub::CreateGroup::execute(const Tile &tile) {
-  groups.emplace_back();
-  groups.back().push_back(tile);
+  if (table.full()) {
+    return false;
+  }
+
+  // A group of a single tile is never legal
+  uint8_t &denomination_count =
+      table.denomination_group_count[tile.denomination];
+  table.denomination_groups[tile.denomination][denomination_count++] =
+      table.group_count;
+  Group &group = table.groups[table.group_count++];
+  group.denomination = static_cast<uint8_t>(tile.denomination);
+  group.colors = static_cast<uint8_t>(1u << tile.color);
+  table.deficient++;
   return true;
 }
 
-void RummiKub::CreateGroup::revert(const Tile &) { groups.pop_back(); }
+void RummiKub::CreateGroup::revert(const Tile &tile) {
+  // The group created last is also the last one of its denomination
+  table.denomination_group_count[tile.denomination]--;
+  table.group_count--;
+  table.deficient--;
+}
 
-bool RummiKub::validate_run(std::vector<Tile> &run) {
-  if (run.size() < 3) {
-    dbg("Run is less than 3 tiles\n");
-    print_vector(run);
-    return false;
-  }
+RummiKub::VirtualActions::VirtualActions(Table &table) {
+  actions.push_back(std::unique_ptr<AddToRun>(new AddToRun(table)));
+  actions.push_back(std::unique_ptr<AddToGroup>(new AddToGroup(table)));
+  actions.push_back(std::unique_ptr<CreateRun>(new CreateRun(table)));
+  actions.push_back(std::unique_ptr<CreateGroup>(new CreateGroup(table)));
+}
 
-  std::vector<Tile> sorted_run{run};
-  std::sort(
-      sorted_run.begin(),
-      sorted_run.end(),
-      [](Tile &current, Tile &next) -> bool {
-        return current.denomination < next.denomination;
-      });
+void RummiKub::VirtualActions::reset() {
+  for (std::unique_ptr<Action> &action: actions) action->reset();
+}
 
-  for (size_t i = 0; i + 1 < sorted_run.size(); i++) {
-    if (sorted_run[i].color != sorted_run[i + 1].color) {
-      dbg("Run is not of one color\n");
-      print_vector(run);
-      return false;
-    }
+RummiKub::ActionSet::ActionSet(Table &table) :
+    add_to_run(table),
+    add_to_group(table),
+    create_run(table),
+    create_group(table) {}
+
+bool RummiKub::ActionSet::execute(size_t action, const Tile &tile) {
+  switch (action) {
+    case 0: return add_to_run.execute(tile);
+    case 1: return add_to_group.execute(tile);
+    case 2: return create_run.execute(tile);
+    default: return create_group.execute(tile);
+  }
+}
 
-    if (sorted_run[i].denomination + 1 != (sorted_run[i + 1].denomination)) {
-      dbg("Run is not consecutive\n");
-      print_vector(sorted_run);
-      return false;
-    }
+void RummiKub::ActionSet::revert(size_t action, const Tile &tile) {
+  switch (action) {
+    case 0: add_to_run.revert(tile); break;
+    case 1: add_to_group.revert(tile); break;
+    case 2: create_run.revert(tile); break;
+    default: create_group.revert(tile); break;
   }
+}
 
-  return true;
+void RummiKub::ActionSet::reset() {
+  add_to_run.reset();
+  add_to_group.reset();
+  create_run.reset();
+  create_group.reset();
 }
 
-bool RummiKub::validate_group(std::vector<Tile> &group) {
-  if (group.size() > 4 || group.size() < 3) {
-    dbg("Group is not within range [3, 4]\n");
-    print_vector(group);
+bool RummiKub::validate_run(const Run &run) {
+  if (!RunRule(run.denominations).legal()) {
+    dbg("Run has a sequence of less than 3 tiles\n");
     return false;
   }
 
-  for (size_t i = 0; i + 1 < group.size(); i++) {
-    if (group[i].color == group[i + 1].color) {
-      dbg("Group has repeat color\n");
-      print_vector(group);
-      return false;
-    }
+  return true;
+}
 
-    if (group[i].denomination != group[i + 1].denomination) {
-      dbg("Group has different denominations\n");
-      print_vector(group);
-      return false;
-    }
+bool RummiKub::validate_group(const Group &group) {
+  if (!GroupRule(group.colors).legal()) {
+    dbg("Group is not within range [3, 4]\n");
+    return false;
   }
 
   return true;
@@ -353,9 +1695,9 @@ bool RummiKub::validate_group(std::vector<Tile> &group) {
 void RummiKub::print_runs() const {
   dbg("print_runs\n");
 
-  for (const std::vector<Tile> &run: runs) {
+  for (int i = 0; i < solution.run_count; i++) {
     dbg("Run\n");
-    print_vector(run);
+    print_range(solution.run_begin(i), solution.run_end(i));
   }
 
   dbg("\n");
@@ -364,11 +1706,26 @@ void RummiKub::print_runs() const {
 void RummiKub::print_groups() const {
   dbg("print_groups\n");
 
-  for (const std::vector<Tile> &group: groups) {
+  for (int i = 0; i < solution.group_count; i++) {
     dbg("Group\n");
 
-    print_vector(group);
+    print_range(solution.group_begin(i), solution.group_end(i));
   }
 
   dbg("\n");
 }
+
+// The batch and parallel engines search with the statically dispatched actions
+template bool RummiKub::solve_brute_force(ActionSet &actions);
+template bool RummiKub::solver_recurse(
+    PackedHand remaining,
+    int last_tile,
+    size_t last_action,
+    ActionSet &actions);
+template void RummiKub::split_search(
+    PackedHand remaining,
+    int last_tile,
+    size_t last_action,
+    int depth,
+    ActionSet &actions,
+    std::vector<SearchTask> &tasks);
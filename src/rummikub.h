@@ -11,11 +11,17 @@
 #ifndef RUMMIKUB_H
 #define RUMMIKUB_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <vector>
 
-enum Color { Red, Green, Blue, Yellow };
+// A Joker plays for any tile: its denomination is ignored when it is added to
+// a hand, and in a play it is the denomination the joker stands for
+enum Color { Red, Green, Blue, Yellow, Joker };
 
 struct Tile {
   int denomination;
@@ -24,50 +30,955 @@ struct Tile {
 
 std::ostream &operator<<(std::ostream &os, Tile const &t);
 
+const int kColors = 4;
+const int kDenominations = 13;
+// The game has two copies of every tile
+const int kGameCopies = 2;
+// What a hand can store: GenerateRandomSolvable in the driver can stack up to
+// four copies (two groups and two runs over the same tile)
+const int kMaxCopies = 4;
+const int kMaxTiles = kColors * kDenominations * kMaxCopies;
+// Jokers a hand may hold on top of its tiles
+const int kMaxJokers = 2;
+
+/**
+ * @brief A variant of the rules: the amount of colors, of denominations (0 to
+ * Denominations - 1) and of copies of a tile a hand may hold. Runs take 3 or
+ * more consecutive tiles of a color and groups 3 tiles or more of a
+ * denomination, one per color. Only the sweep of rummikub_sweep.h is
+ * templated on it (IsPlayable and FindPlay), RummiKub and its Tile keep the
+ * colors and denominations of the game.
+ */
+template<int Colors, int Denominations, int Copies>
+struct Rules {
+  static const int kColors = Colors;
+  static const int kDenominations = Denominations;
+  static const int kCopies = Copies;
+};
+
+// The rules of the game
+typedef Rules<kColors, kDenominations, kGameCopies> GameRules;
+// The rules of the game with room for every copy a RummiKub hand can store,
+// the ones its DynamicProgramming engine sweeps with
+typedef Rules<kColors, kDenominations, kMaxCopies> StoredRules;
+
+/**
+ * @brief What the rules say about the tiles of a run (a mask of its
+ * denominations) or of a group (a mask of its colors), read from a table made
+ * at compile time. A set is completable when it can still become legal by
+ * only adding tiles above its highest one, the order the brute-force search
+ * places them in.
+ */
+struct SetRule {
+  static const uint8_t kLegal = 1;
+  static const uint8_t kCompletable = 2;
+
+  // legal, completable, tiles needed (2 bits), highest tile (4 bits)
+  uint8_t bits;
+
+  bool legal() const { return bits & kLegal; }
+  bool completable() const { return bits & kCompletable; }
+  // Tiles to add right above the highest one before the set is legal
+  int needed() const { return (bits >> 2) & 3; }
+  // Highest denomination of a run (unused for groups)
+  int top() const { return bits >> 4; }
+};
+
+namespace set_rules {
+  constexpr unsigned covered(unsigned starts) {
+    return starts | (starts << 1) | (starts << 2);
+  }
+
+  // Every sequence of a run has 3 or more tiles when the windows of 3 full
+  // bits cover the whole mask
+  constexpr bool run_legal(unsigned mask) {
+    return mask != 0 && covered(mask & (mask >> 1) & (mask >> 2)) == mask;
+  }
+
+  constexpr int highest(unsigned mask, int bit) {
+    return bit < 0 || ((mask >> bit) & 1) ? bit : highest(mask, bit - 1);
+  }
+
+  constexpr int length_down(unsigned mask, int bit) {
+    return bit >= 0 && ((mask >> bit) & 1) ? 1 + length_down(mask, bit - 1)
+                                           : 0;
+  }
+
+  constexpr int count(unsigned mask) {
+    return mask == 0 ? 0 : static_cast<int>(mask & 1) + count(mask >> 1);
+  }
+
+  constexpr int needed(int length) { return length >= 3 ? 0 : 3 - length; }
+
+  constexpr uint8_t pack(bool legal, bool completable, int needed, int top) {
+    return static_cast<uint8_t>(
+        (legal ? SetRule::kLegal : 0) |
+        (completable ? SetRule::kCompletable : 0) | (needed << 2) | (top << 4));
+  }
+
+  // Only the sequence ending at the highest tile can still grow, the ones
+  // under it must already be legal
+  constexpr uint8_t run_sequence(unsigned mask, int top, int length) {
+    return pack(
+        run_legal(mask),
+        (mask == (((1u << length) - 1) << (top - length + 1)) ||
+         run_legal(mask & ~(((1u << length) - 1) << (top - length + 1)))) &&
+            top + needed(length) < kDenominations,
+        needed(length),
+        top);
+  }
+
+  constexpr uint8_t run_top(unsigned mask, int top) {
+    return run_sequence(mask, top, length_down(mask, top));
+  }
+
+  constexpr uint8_t run(unsigned mask) {
+    return mask == 0 ? pack(false, false, 3, 0)
+                     : run_top(mask, highest(mask, kDenominations - 1));
+  }
+
+  constexpr uint8_t group(unsigned colors) {
+    return pack(
+        count(colors) >= 3,
+        colors != 0 && count(colors) <= kColors,
+        needed(count(colors)),
+        0);
+  }
+
+  template<unsigned... I>
+  struct Indices {
+    typedef Indices<I..., (sizeof...(I) + I)...> Doubled;
+  };
+
+  // 0 to N - 1, N a power of 2, made by doubling to keep the templates shallow
+  template<unsigned N>
+  struct MakeIndices {
+    static_assert((N & (N - 1)) == 0, "N must be a power of 2");
+    typedef typename MakeIndices<N / 2>::Type::Doubled Type;
+  };
+
+  template<>
+  struct MakeIndices<1> {
+    typedef Indices<0> Type;
+  };
+
+  template<typename Runs, typename Groups>
+  struct Tables;
+
+  template<unsigned... R, unsigned... G>
+  struct Tables<Indices<R...>, Indices<G...>> {
+    static constexpr uint8_t runs[sizeof...(R)] = {run(R)...};
+    static constexpr uint8_t groups[sizeof...(G)] = {group(G)...};
+  };
+
+  template<unsigned... R, unsigned... G>
+  constexpr uint8_t Tables<Indices<R...>, Indices<G...>>::runs[sizeof...(R)];
+  template<unsigned... R, unsigned... G>
+  constexpr uint8_t Tables<Indices<R...>, Indices<G...>>::groups[sizeof...(G)];
+
+  typedef Tables<
+      MakeIndices<1u << kDenominations>::Type,
+      MakeIndices<1u << kColors>::Type>
+      RuleTables;
+
+  static_assert(run(0x7) == pack(true, true, 0, 2), "123 is legal");
+  static_assert(run(0x1EF) == pack(true, true, 0, 8), "1234-6789 is legal");
+  static_assert(run(0x67) == pack(false, true, 1, 6), "123--67 needs 1 tile");
+  static_assert(run(0x63) == pack(false, false, 1, 6), "12 cannot grow");
+  static_assert(run(0x1000) == pack(false, false, 2, 12), "13 cannot grow");
+  static_assert(group(0xB) == pack(true, true, 0, 0), "3 colors are legal");
+} // namespace set_rules
+
+/**
+ * @brief The rules of a run.
+ *
+ * @param denominations The mask of its denominations (bit d for d).
+ * @return What the rules say about it.
+ */
+inline SetRule RunRule(unsigned denominations) {
+  return SetRule{set_rules::RuleTables::runs[denominations]};
+}
+
+/**
+ * @brief The rules of a group.
+ *
+ * @param colors The mask of its colors (bit c for color c).
+ * @return What the rules say about it.
+ */
+inline SetRule GroupRule(unsigned colors) {
+  return SetRule{set_rules::RuleTables::groups[colors]};
+}
+
+/**
+ * @brief A read-only view of tiles stored somewhere else, such as a set of the
+ * play found by RummiKub. It is valid until the solver changes.
+ */
+struct TileRange {
+  const Tile *first;
+  const Tile *last;
+
+  const Tile *begin() const { return first; }
+  const Tile *end() const { return last; }
+  size_t size() const { return static_cast<size_t>(last - first); }
+  bool empty() const { return first == last; }
+  const Tile &operator[](size_t index) const { return first[index]; }
+};
+
+/**
+ * @brief What a Solve() did, collected when RummiKub::SetStatsEnabled(true)
+ * was called. The counters are filled by the brute-force engines, the other
+ * engines only report their times.
+ */
+struct SolverStats {
+  // AddToRun, AddToGroup, CreateRun, CreateGroup
+  static const int kActions = 4;
+
+  // States searched, and the ones with every tile placed (checked for a play)
+  uint64_t nodes;
+  uint64_t leaves;
+  // execute() calls that placed the tile and that could not, per action
+  uint64_t executed[kActions];
+  uint64_t rejected[kActions];
+  // Actions undone right away by the forward checking
+  uint64_t pruned;
+  // Actions undone after nothing was found below them
+  uint64_t backtracks;
+  // States skipped because the transposition table knew they fail
+  uint64_t transposition_hits;
+  // Most tiles placed at once
+  int max_depth;
+  // States with d tiles placed and the children they searched, the branching
+  // factor at depth d is depth_children[d] / depth_nodes[d]
+  uint64_t depth_nodes[kMaxTiles + 1];
+  uint64_t depth_children[kMaxTiles + 1];
+  // Wall time of emptying the table, of the search and of storing the play
+  double setup_seconds;
+  double search_seconds;
+  double store_seconds;
+
+  /**
+   * @brief Add the counters of another search (of the same hand) to these.
+   *
+   * @param other The counters to add.
+   */
+  void add(const SolverStats &other);
+};
+
+std::ostream &operator<<(std::ostream &os, SolverStats const &stats);
+
+/**
+ * @brief A hand packed into bitmasks. The tile (denomination, color) is the bit
+ * (denomination * kColors + color), which puts the bits in the same order as a
+ * hand sorted by denomination then color. copies[i] has the tiles the hand has
+ * more than i copies of, so every mask is a subset of the one before it and a
+ * regular hand only uses the first two.
+ */
+struct PackedHand {
+  uint64_t copies[kMaxCopies];
+
+  /**
+   * @brief Add a tile to the hand.
+   *
+   * @param tile The tile to add.
+   * @return false if the hand already has kMaxCopies copies of the tile.
+   */
+  bool add(const Tile &tile) {
+    uint64_t bit = uint64_t{1} << bit_index(tile);
+    for (uint64_t &copy: copies) {
+      if (!(copy & bit)) {
+        copy |= bit;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Take out one copy of the tile with the given bit index.
+   *
+   * @param index The bit index of the tile.
+   */
+  void remove(int index) {
+    uint64_t bit = uint64_t{1} << index;
+    int copy = kMaxCopies - 1;
+    while (copy > 0 && !(copies[copy] & bit)) copy--;
+    copies[copy] &= ~bit;
+  }
+
+  bool empty() const { return copies[0] == 0; }
+
+  /**
+   * @return The amount of copies of the tile with the given bit index.
+   */
+  int count(int index) const {
+    int total = 0;
+    for (uint64_t copy: copies) total += static_cast<int>((copy >> index) & 1);
+    return total;
+  }
+
+  static int bit_index(const Tile &tile) {
+    return tile.denomination * kColors + tile.color;
+  }
+
+  static Tile tile(int index) {
+    return Tile{index / kColors, static_cast<Color>(index % kColors)};
+  }
+};
+
+/**
+ * @brief A rest of a hand that the ExactCover engine could not cover, tagged
+ * with the solve_cover call that stored it.
+ */
+struct CoverFailure {
+  PackedHand hand;
+  uint32_t generation;
+};
+
 class RummiKub {
 public:
+  /**
+   * @brief The algorithm used by Solve() to find a play.
+   */
+  enum Engine {
+    // The handout's brute-force recursion (see solver_recurse)
+    BruteForce,
+    // Sweep over the denominations keeping the state of the runs per color
+    DynamicProgramming,
+    // Exact cover of the hand with the table of every legal set
+    ExactCover,
+    // The brute-force recursion with its top levels split over threads
+    ParallelBruteForce,
+    // BruteForce calling the actions through their vtable, for comparison
+    BruteForceVirtual,
+    // The brute-force recursion placing the tile with the fewest actions left
+    // first, and trying the actions in the order of SetActionOrder()
+    BruteForceMostConstrained
+  };
+
+  /**
+   * @brief What Solve() looks for.
+   */
+  enum Objective {
+    // A play of every tile of the hand, or none
+    PlayAll,
+    // The play of the most tiles, the others stay in the hand
+    MostTiles,
+    // The play worth the most points, a tile is worth its denomination + 1
+    MostPoints
+  };
+
+  /**
+   * @brief Write the order in which BruteForceMostConstrained tries the
+   * actions for a tile (0 AddToRun, 1 AddToGroup, 2 CreateRun, 3
+   * CreateGroup). The order must be a permutation that only depends on the
+   * tile: the copies of a tile skip the actions the previous copy tried
+   * before the one it used.
+   *
+   * @param tile The tile about to be placed.
+   * @param order Where to write the actions, first to try first.
+   */
+  typedef void (*ActionOrder)(
+      const Tile &tile, uint8_t order[SolverStats::kActions]);
+
   RummiKub(); // empty hand
 
   /**
-   * @brief This function adds a tile to the hand.
+   * @brief Create an empty hand that will be solved with the given engine.
+   *
+   * @param engine The engine to use in Solve().
+   */
+  explicit RummiKub(Engine engine);
+
+  /**
+   * @brief Write the spans of the trace that are still buffered, if any.
+   */
+  ~RummiKub();
+
+  /**
+   * @brief Select the engine used by Solve().
+   *
+   * @param engine The engine to use.
+   */
+  void SetEngine(Engine engine);
+
+  /**
+   * @brief Set the memory the brute-force engine may use to remember the
+   * states it failed to solve (0 turns it off). The memory is taken by the
+   * next Solve() and kept for the ones after it.
+   *
+   * @param bytes The memory budget in bytes.
+   */
+  void SetTranspositionTableSize(size_t bytes);
+
+  /**
+   * @brief Set the amount of threads the ParallelBruteForce engine searches
+   * with (0 for one per core). Hands that fill less than 10 sets (under 30
+   * tiles and jokers) are solved on the calling thread alone, faster than the
+   * threads would start.
+   *
+   * @param threads The amount of threads.
+   */
+  void SetThreadCount(unsigned threads);
+
+  /**
+   * @brief Set the order BruteForceMostConstrained tries the actions in.
+   *
+   * @param order The policy, nullptr for the order of the handout.
+   */
+  void SetActionOrder(ActionOrder order);
+
+  /**
+   * @brief Select what Solve() looks for. The objectives other than PlayAll
+   * have their own search (see solve_subset) whatever the engine is, and do
+   * not play jokers.
+   *
+   * @param objective The objective of the next solves.
+   */
+  void SetObjective(Objective objective);
+
+  /**
+   * @brief Limit the time Solve() spends on MostTiles and MostPoints. When it
+   * runs out, the best play found so far is kept (a part of the hand not
+   * searched yet gets the first legal play found for it) and TimedOut()
+   * tells.
+   *
+   * @param seconds The time budget, 0 for none.
+   */
+  void SetTimeBudget(double seconds);
+
+  /**
+   * @brief This function adds a tile to the hand. A tile of color Joker adds
+   * a joker, which only the brute-force engines can play.
    *
    * @param tile The tile to add.
    */
   void Add(Tile const &tile); // add a tile to the hand
 
   /**
-   * @brief Find the play that plays all the tiles in the hand.
+   * @brief Find the play that plays all the tiles in the hand, or the best
+   * part of it for the objectives other than PlayAll.
    */
   void Solve(); // solve
 
+  /**
+   * @brief Find out if the hand can be played entirely, without building the
+   * play. Counting filters reject most of the hands that cannot be played
+   * before any search, the others are searched with the engine of Solve(),
+   * which stops as soon as it knows the answer. Like Solve(), the hand is
+   * emptied afterwards, and no play is kept.
+   *
+   * @return If every tile can be placed in a legal set (true for no tiles).
+   */
+  bool IsSolvable();
+
+  /**
+   * @brief Empty the hand and forget the last play, to start over with a new
+   * hand. Everything the solver uses is kept (the set storage and action
+   * stacks are part of the object, and the transposition table keeps its
+   * memory), so solving hand after hand never allocates.
+   */
+  void Reset();
+
+  /**
+   * @brief Find out which of many hands can be played entirely. Every worker
+   * thread has its own solver and takes chunks of hands from a shared counter,
+   * which is the only state the workers share. Once a worker is running no
+   * memory is allocated per hand. Unlike Solve(), the hands are searched
+   * whole: the split into components of DECOMPOSE_HAND is not made. An
+   * exception thrown by a worker (a tile that cannot be added, running out of
+   * memory, ...) stops that worker and is thrown again here once every worker
+   * is done.
+   *
+   * @param tiles The tiles of every hand, one hand after the other.
+   * @param offsets hand_count + 1 indices into tiles, hand i has the tiles
+   * from offsets[i] to offsets[i + 1] (not included).
+   * @param hand_count The amount of hands.
+   * @param solvable Where to write if each hand can be played (an empty hand
+   * can), hand_count entries allocated by the caller.
+   * @param threads The amount of threads to use (0 for one per core).
+   * @param engine The engine that solves the hands.
+   */
+  static void SolveBatch(
+      const Tile *tiles,
+      const size_t *offsets,
+      size_t hand_count,
+      bool *solvable,
+      unsigned threads = 0,
+      Engine engine = BruteForce);
+
   // get solution - groups
   std::vector<std::vector<Tile>> GetGroups() const;
   // get solution - runs
   std::vector<std::vector<Tile>> GetRuns() const;
   // if both vectors are empty - no solution possible
 
+  /**
+   * @return The amount of runs of the play found (0 if there is none).
+   */
+  size_t GetRunCount() const;
+
+  /**
+   * @brief View a run of the play found without copying it. The view is valid
+   * until the next Solve() or Reset().
+   *
+   * @param index The run, less than GetRunCount().
+   * @return The tiles of the run.
+   */
+  TileRange GetRun(size_t index) const;
+
+  /**
+   * @return The amount of groups of the play found (0 if there is none).
+   */
+  size_t GetGroupCount() const;
+
+  /**
+   * @brief View a group of the play found without copying it. The view is
+   * valid until the next Solve() or Reset().
+   *
+   * @param index The group, less than GetGroupCount().
+   * @return The tiles of the group.
+   */
+  TileRange GetGroup(size_t index) const;
+
+  // Bytes EncodeSolution() writes at most: the two counts, then a size and
+  // the tiles of every set
+  static const size_t kMaxEncodedSize =
+      2 + (kMaxTiles + kMaxJokers) / 3 + kMaxTiles + kMaxJokers;
+
+  /**
+   * @brief Write the play found in a flat form: the amount of runs and of
+   * groups, then every run and every group as its amount of tiles followed by
+   * its tiles. Every value takes one byte, a tile is denomination * kColors +
+   * color and a joker kColors * kDenominations + the denomination it stands
+   * for. The encoding of no play is two zeros.
+   *
+   * @param buffer Where to write, at least kMaxEncodedSize bytes.
+   * @return The amount of bytes written.
+   */
+  size_t EncodeSolution(uint8_t *buffer) const;
+
+  /**
+   * @brief Read back a play written by EncodeSolution().
+   *
+   * @param buffer The encoded play.
+   * @param size The amount of bytes in buffer.
+   * @param runs Where to write the runs.
+   * @param groups Where to write the groups.
+   */
+  static void DecodeSolution(
+      const uint8_t *buffer,
+      size_t size,
+      std::vector<std::vector<Tile>> &runs,
+      std::vector<std::vector<Tile>> &groups);
+
+  /**
+   * @return The tiles of the last hand solved that the play found leaves in
+   * the hand (all of them if there is no play), jokers included.
+   */
+  std::vector<Tile> GetLeftover() const;
+
+  /**
+   * @return If the last Solve() ran out of its time budget, so that its play
+   * is the best it found rather than the best there is.
+   */
+  bool TimedOut() const;
+
+  /**
+   * @return The amount of states the brute-force engines searched in the last
+   * Solve() (0 for the other engines).
+   */
+  uint64_t GetNodeCount() const;
+
+  /**
+   * @brief Turn the collection of SolverStats on or off. It costs a test per
+   * state searched when off.
+   *
+   * @param enabled If the next solves collect statistics.
+   */
+  void SetStatsEnabled(bool enabled);
+
+  /**
+   * @return The statistics of the last Solve() (all 0 if they were off).
+   */
+  const SolverStats &GetStats() const;
+
+  // Actions taken between two spans of the trace by default
+  static const unsigned kDefaultTraceInterval = 256;
+
+  /**
+   * @brief Trace the brute-force search in the Chrome trace-event format
+   * (chrome://tracing, Perfetto). Every sample_interval-th action that leads
+   * to a recursion becomes a span from its execution until it is undone or a
+   * play is found, named after the action and with the amount of tiles
+   * placed as its depth. Spans are buffered and written in batches, the
+   * stream gets an array that the trace viewers accept without its closing
+   * bracket. Only the times of the sampled actions are read, so tracing costs
+   * little more than a counter per action.
+   *
+   * @param out Where to write the trace, nullptr to stop tracing (which
+   * writes the spans still buffered).
+   * @param sample_interval Actions between two spans (at least 1).
+   */
+  void SetTrace(
+      std::ostream *out, unsigned sample_interval = kDefaultTraceInterval);
+
   /**
    * @brief This prints the solution calculated
    */
   void print_solution();
 
 private:
-  std::vector<Tile> tiles{};
+  // Tiles of a play, with the jokers
+  static const int kMaxPlayed = kMaxTiles + kMaxJokers;
+
+  // Every set holds at least 3 tiles, so a play never has more sets than this
+  static const int kMaxSets = kMaxPlayed / 3;
+
+  // Every tile creates at most one set, so a color has at most as many runs as
+  // it has tiles, and so does a denomination with its groups
+  static const int kMaxColorRuns = kDenominations * kMaxCopies;
+  static const int kMaxDenominationGroups = kColors * kMaxCopies;
+
+  Engine engine{BruteForce};
+  Objective objective{PlayAll};
+  double time_budget{0};
+
+  PackedHand hand{{0, 0, 0, 0}};
+
+  // Jokers of the hand, kept out of the search: the sets only get them once
+  // every tile is placed (see place_jokers)
+  int jokers{0};
+
+  /**
+   * @brief The sets of the play found, in one buffer that is part of the
+   * object so that storing a play never allocates. Runs are stored from the
+   * front and groups from the back. A play has as many tiles as the hand, so
+   * the two never meet.
+   *
+   * Group: a sequence
+   * 1) of 3 or 4 tiles
+   * 2) same denominations
+   * 3) no tiles of the same color
+   *
+   * Run (classical): a sequence
+   * 1) of 3 or more tiles
+   * 2) all tiles have the same color
+   * 3) denomination are consecutive
+   */
+  struct SetSlab {
+    Tile tiles[kMaxPlayed];
+    // run i has the tiles from run_ends[i - 1] (0 for the first) to run_ends[i]
+    uint8_t run_ends[kMaxSets];
+    // group i has the tiles from group_starts[i] to group_starts[i - 1]
+    // (kMaxPlayed for the first)
+    uint8_t group_starts[kMaxSets];
+    uint8_t run_count;
+    uint8_t group_count;
+
+    void clear() {
+      run_count = 0;
+      group_count = 0;
+    }
+
+    /**
+     * @brief Make room for a run.
+     *
+     * @param size The amount of tiles of the run.
+     * @return Where to write the tiles.
+     */
+    Tile *add_run(int size) {
+      int start = run_count == 0 ? 0 : run_ends[run_count - 1];
+      run_ends[run_count++] = static_cast<uint8_t>(start + size);
+      return tiles + start;
+    }
 
-  // Group: a sequence
-  // 1) of 3 or 4 tiles
-  // 2) same denominations
-  // 3) no tiles of the same color
-  std::vector<std::vector<Tile>> groups{};
+    /**
+     * @brief Make room for a group.
+     *
+     * @param size The amount of tiles of the group.
+     * @return Where to write the tiles.
+     */
+    Tile *add_group(int size) {
+      int end = group_count == 0 ? kMaxPlayed : group_starts[group_count - 1];
+      group_starts[group_count++] = static_cast<uint8_t>(end - size);
+      return tiles + end - size;
+    }
 
-  // Run (classical): a sequence
-  // 1) of 3 or more tiles
-  // 2) all tiles have the same color
-  // 3) denomination are consecutive
-  std::vector<std::vector<Tile>> runs{};
+    const Tile *run_begin(int run) const {
+      return tiles + (run == 0 ? 0 : run_ends[run - 1]);
+    }
+    const Tile *run_end(int run) const { return tiles + run_ends[run]; }
 
+    const Tile *group_begin(int group) const {
+      return tiles + group_starts[group];
+    }
+    const Tile *group_end(int group) const {
+      return tiles + (group == 0 ? kMaxPlayed : group_starts[group - 1]);
+    }
+  };
+
+  SetSlab solution{};
+
+  /**
+   * @brief A run while searching: bit d of denominations is set when the run
+   * has the tile of denomination d.
+   */
+  struct Run {
+    uint16_t denominations;
+    uint8_t color;
+  };
+
+  /**
+   * @brief A group while searching: bit c of colors is set when the group has
+   * the tile of color c.
+   */
+  struct Group {
+    uint8_t denomination;
+    uint8_t colors;
+  };
+
+  /**
+   * @brief The sets on the table while searching. This is the whole state the
+   * actions modify, so it is kept small and free of heap allocations.
+   */
+  struct Table {
+    Run runs[kMaxSets];
+    Group groups[kMaxSets];
+    uint8_t run_count;
+    uint8_t group_count;
+    // amount of sets the hand can fill with at least 3 tiles each
+    uint8_t set_limit;
+    // amount of sets that are not legal (yet), kept up to date by the actions
+    int deficient;
+    // how far a tile may be from a run to join it (1, more with jokers)
+    uint8_t reach;
+
+    // The runs of every color and the groups of every denomination, as
+    // indices into runs and groups in the order they were created, so that
+    // adding a tile only looks at the sets it could join
+    uint8_t color_runs[kColors][kMaxColorRuns];
+    uint8_t color_run_count[kColors];
+    uint8_t denomination_groups[kDenominations][kMaxDenominationGroups];
+    uint8_t denomination_group_count[kDenominations];
+
+    bool full() const { return run_count + group_count >= set_limit; }
+
+    /**
+     * @brief Take every set off the table.
+     */
+    void clear() {
+      run_count = 0;
+      group_count = 0;
+      deficient = 0;
+      std::fill(color_run_count, color_run_count + kColors, 0);
+      std::fill(
+          denomination_group_count,
+          denomination_group_count + kDenominations,
+          0);
+    }
+  };
+
+  Table table{};
+
+  /**
+   * @brief A state of the search that is known to fail. A run that can no
+   * longer grow or a group of a denomination already placed is legal (the
+   * forward checking made sure of it), so the key only describes the sets that
+   * can still change:
+   *
+   * runs: for every color, how many runs with 1, 2 and 3+ tiles end at the
+   * previous or at the current denomination (base 5, 14 bits per color), then
+   * the first action the next tile may use.
+   *
+   * groups: the color masks of the groups of the current denomination (sorted,
+   * 4 bits each), then the amount of tiles left and of sets on the table.
+   */
+  struct Transposition {
+    uint64_t runs;
+    uint64_t groups;
+    uint32_t generation; // Solve() call that stored it
+    // Most value the tiles left can add, for the search of the best part of
+    // a hand (0 for the others)
+    int32_t value;
+  };
+
+  /**
+   * @brief Two states share an index: the first slot keeps the one with the
+   * most tiles left (the largest subtree) and the second the newest one.
+   */
+  struct TranspositionBucket {
+    Transposition deepest;
+    Transposition newest;
+  };
+
+  size_t transposition_bytes;
+  std::vector<TranspositionBucket> transpositions{};
+  uint32_t generation{0};
+  // only large hands use the table
+  bool use_transpositions{false};
+
+  // Direct mapped cache of the ExactCover engine, allocated by the first
+  // solve_cover and told apart from the previous calls by cover_generation
+  std::vector<CoverFailure> cover_failures{};
+  uint32_t cover_generation{0};
+
+  // states searched by the brute-force engines since prepare_brute_force
+  uint64_t nodes{0};
+
+  bool collect_stats{false};
+  SolverStats stats{};
+  // tiles of the hand being searched, to know the depth of a state
+  int hand_size{0};
+
+  unsigned thread_count{0};
+
+  ActionOrder action_order{nullptr};
+
+  // Tiles and jokers the play found leaves in the hand
+  PackedHand leftover{{0, 0, 0, 0}};
+  int leftover_jokers{0};
+
+  /**
+   * @brief The state of the search for the best part of a hand, kept per
+   * component of the hand.
+   */
+  struct SubsetSearch {
+    // Value of the tiles on the table and of the best play found
+    int placed;
+    int best;
+    // Value of every tile of the component, no play beats it
+    int limit;
+    // Tiles of the component left in the hand, now and in the best play
+    PackedHand left;
+    PackedHand best_left;
+    // Sets of the play stored for the components before this one
+    uint8_t base_runs;
+    uint8_t base_groups;
+    // If a legal table was reached, which is all a component gets once the
+    // time is out
+    bool found;
+    bool timed_out;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  SubsetSearch subset{};
+
+  /**
+   * @brief A sampled action of the search, times in nanoseconds since
+   * SetTrace().
+   */
+  struct TraceSpan {
+    uint64_t start;
+    uint64_t duration;
+    uint16_t depth;
+    uint16_t thread;
+    uint8_t action;
+  };
+
+  std::ostream *trace_out{nullptr};
+  unsigned trace_interval{0};
+  // actions left before the next span, 0 when tracing is off
+  unsigned trace_countdown{0};
+  // thread of ParallelBruteForce the spans of this solver belong to
+  uint16_t trace_thread{0};
+  std::chrono::steady_clock::time_point trace_origin{};
+  std::vector<TraceSpan> trace_spans{};
+
+  // Set by another thread to stop the search (nullptr if nothing can)
+  const std::atomic<bool> *cancelled{nullptr};
+
+  /**
+   * @brief A subtree of the search for a thread of ParallelBruteForce: the
+   * table after the first tiles were placed and the arguments of
+   * solver_recurse for the rest of them.
+   */
+  struct SearchTask {
+    Table table;
+    PackedHand remaining;
+    int last_tile;
+    size_t last_action;
+  };
+
+  /**
+   * @brief Build the key of the state the search is in.
+   *
+   * @param remaining The tiles that have not been placed yet
+   * @param next_tile Bit index of the tile about to be placed
+   * @param first_action First action that tile may use
+   * @param key Where to write the key
+   * @return false if the state is too small to be worth remembering or does
+   * not fit in a key
+   */
+  bool transposition_key(
+      const PackedHand &remaining,
+      int next_tile,
+      size_t first_action,
+      Transposition &key) const;
+
+  /**
+   * @return The entry stored for the state, nullptr if there is none.
+   */
+  const Transposition *transposition_find(const Transposition &key) const;
+
+  /**
+   * @return If the state was already found to fail.
+   */
+  bool transposition_failed(const Transposition &key) const {
+    return transposition_find(key) != nullptr;
+  }
+
+  /**
+   * @brief Remember that a state fails, or the value it can add.
+   */
+  void transposition_store(const Transposition &key);
+
+  /**
+   * @brief Write the buffered spans to trace_out.
+   */
+  void flush_trace();
+
+  /**
+   * @brief Call solver_recurse and keep its time as a span of the trace.
+   *
+   * @param remaining The tiles that have not been placed yet
+   * @param index Bit index of the tile just placed
+   * @param action Index of the action that placed it
+   * @param actions The actions to try
+   * @return The success of solver_recurse
+   */
+  template<typename Actions>
+  bool traced_recurse(
+      const PackedHand &remaining,
+      int index,
+      size_t action,
+      Actions &actions);
+
+  /**
+   * @brief Check that every set on the table is legal. The actions keep count
+   * of the sets that are not, so this is a single test.
+   *
+   * @return If the solution is valid
+   */
   bool validate_solution();
 
+  /**
+   * @brief Find where the jokers go once every tile is on the table: the
+   * fewest that make every set legal (filling the gaps of runs and the
+   * missing colors of groups), then the rest into any set with room.
+   *
+   * @param run_fills Where to write the denominations the jokers take in every
+   * run, nullptr to only check
+   * @param group_fills Where to write the jokers of every group, nullptr to
+   * only check
+   * @return false if the jokers cannot make a legal play
+   */
+  bool place_jokers(uint16_t *run_fills, uint8_t *group_fills) const;
+
+  /**
+   * @brief Copy the sets on the table into runs and groups.
+   */
+  void store_solution();
+
   /**
    * @brief This represents an action that can be played in the game.
    */
@@ -89,86 +1000,375 @@ private:
      */
     virtual void revert(const Tile &tile) = 0;
 
+    /**
+     * @brief Forget the executions of a previous search that were never
+     * reverted (the ones of the play found).
+     */
+    void reset() { insert_count = 0; }
+
   protected:
-    std::vector<size_t> inserts{};
+    // Sets the tile was added to, at most one per tile of the hand
+    uint8_t inserts[kMaxTiles];
+    int insert_count{0};
   };
 
   /**
    * @brief add it to an existing run with the same color as tile and tile's
    * denomination is not yet in the run
    */
-  struct AddToRun : Action {
-    explicit AddToRun(std::vector<std::vector<Tile>> &runs);
+  struct AddToRun final : Action {
+    explicit AddToRun(Table &table);
 
     bool execute(const Tile &tile) override;
     void revert(const Tile &tile) override;
 
   private:
-    std::vector<std::vector<Tile>> &runs;
+    Table &table;
   };
 
   /**
    * @brief  add it to an existing group with the same denomination as tile
    * and tile's color is not yet in the group
    */
-  struct AddToGroup : Action {
-    explicit AddToGroup(std::vector<std::vector<Tile>> &groups);
+  struct AddToGroup final : Action {
+    explicit AddToGroup(Table &table);
 
     bool execute(const Tile &tile) override;
     void revert(const Tile &tile) override;
 
   private:
-    std::vector<std::vector<Tile>> &groups;
+    Table &table;
   };
 
   /**
    * @brief Create a new run
    */
-  struct CreateRun : Action {
-    explicit CreateRun(std::vector<std::vector<Tile>> &runs);
+  struct CreateRun final : Action {
+    explicit CreateRun(Table &table);
 
     bool execute(const Tile &tile) override;
     void revert(const Tile &tile) override;
 
   private:
-    std::vector<std::vector<Tile>> &runs;
-
-    bool check_for_run_bridge(
-        const Tile &tile,
-        const std::vector<Tile> &run_a,
-        const std::vector<Tile> &run_b);
+    Table &table;
   };
 
   /**
    * @brief Create a new group
    */
-  struct CreateGroup : Action {
-    explicit CreateGroup(std::vector<std::vector<Tile>> &groups);
+  struct CreateGroup final : Action {
+    explicit CreateGroup(Table &table);
 
     bool execute(const Tile &tile) override;
     void revert(const Tile &tile) override;
 
   private:
-    std::vector<std::vector<Tile>> &groups;
+    Table &table;
+  };
+
+  /**
+   * @brief The actions of the handout, allocated separately and called through
+   * the Action base so that every call goes through the vtable.
+   */
+  struct VirtualActions {
+    explicit VirtualActions(Table &table);
+
+    static size_t size() { return 4; }
+
+    bool execute(size_t action, const Tile &tile) {
+      return actions[action]->execute(tile);
+    }
+
+    void revert(size_t action, const Tile &tile) {
+      actions[action]->revert(tile);
+    }
+
+    void reset();
+
+  private:
+    std::vector<std::unique_ptr<Action>> actions;
   };
 
   /**
-   * @brief Recursive function to solve the hand.
+   * @brief The same actions held by value and picked with a switch. The
+   * compiler knows which execute() and revert() each case calls, so it can
+   * inline them into the search loop. The actions refer to a table, so the
+   * set is never copied.
+   */
+  struct ActionSet {
+    explicit ActionSet(Table &table);
+    ActionSet(const ActionSet &) = delete;
+    ActionSet &operator=(const ActionSet &) = delete;
+
+    static size_t size() { return 4; }
+
+    bool execute(size_t action, const Tile &tile);
+    void revert(size_t action, const Tile &tile);
+    void reset();
+
+  private:
+    AddToRun add_to_run;
+    AddToGroup add_to_group;
+    CreateRun create_run;
+    CreateGroup create_group;
+  };
+
+  /**
+   * @brief Set up the table for the hand and run the brute-force search. The
+   * sets found are left on the table.
    *
-   * @param current_tile The tile to use
+   * @param actions The actions to try (VirtualActions or ActionSet)
+   * @return The success of the solve
+   */
+  template<typename Actions>
+  bool solve_brute_force(Actions &actions);
+
+  /**
+   * @brief Set up the table for the hand and run the most constrained first
+   * search. The sets found are left on the table.
+   *
+   * @param actions The actions to try
+   * @return The success of the solve
+   */
+  bool solve_most_constrained(ActionSet &actions);
+
+  /**
+   * @brief Recursive function of BruteForceMostConstrained. The next tile is
+   * the one of the lowest denomination left with the fewest actions that
+   * pass the forward checking, unless the previous tile has copies left,
+   * which go first. Keeping to the lowest denomination keeps the runs growing
+   * upwards like in solver_recurse, so that completable() still holds.
+   *
+   * @param remaining The tiles that have not been placed yet
+   * @param last_tile Bit index of the tile placed before this call (-1 if none)
+   * @param last_position Position in the action order of the action used for
+   * that tile
    * @param actions The actions to try
    * @return The success of the solve
    */
+  bool ordered_recurse(
+      PackedHand remaining,
+      int last_tile,
+      size_t last_position,
+      ActionSet &actions);
+
+  /**
+   * @brief Count the actions a tile could take that pass the forward checking,
+   * leaving the table as it was.
+   *
+   * @param remaining The tiles left once the tile is placed
+   * @param tile The tile to place
+   * @param actions The actions to try
+   * @return The amount of actions
+   */
+  int viable_actions(
+      const PackedHand &remaining, const Tile &tile, ActionSet &actions);
+
+  /**
+   * @brief Empty the table and get the transposition table ready for the
+   * hand, without searching.
+   */
+  void prepare_brute_force();
+
+  /**
+   * @brief Solve the hand by splitting the brute-force search into subtrees
+   * that threads search and steal from each other. The first thread to find a
+   * play stops the others and its sets are left on the table. The split goes
+   * one tile deeper at a time until there are enough subtrees, and its states
+   * count in nodes. Hands that fill less than 10 sets (kParallelMinSets) are
+   * searched by solver_recurse alone.
+   *
+   * @return The success of the solve
+   */
+  bool solve_parallel();
+
+  /**
+   * @brief Place the tiles like solver_recurse does down to a depth, and keep
+   * every table reached there as a task instead of going further.
+   *
+   * @param remaining The tiles that have not been placed yet
+   * @param last_tile Bit index of the tile placed before this call (-1 if none)
+   * @param last_action Index of the action used for that tile
+   * @param depth The amount of tiles left to place before making a task
+   * @param actions The actions to try
+   * @param tasks Where to add the tasks
+   */
+  template<typename Actions>
+  void split_search(
+      PackedHand remaining,
+      int last_tile,
+      size_t last_action,
+      int depth,
+      Actions &actions,
+      std::vector<SearchTask> &tasks);
+
+  /**
+   * @brief Solve the hands of a batch until there are none left. This is the
+   * work of a single SolveBatch() thread, with this object as its solver.
+   *
+   * @param tiles The tiles of every hand
+   * @param offsets Where the tiles of each hand start
+   * @param hand_count The amount of hands
+   * @param solvable Where to write if each hand can be played
+   * @param next_hand The first hand no thread has taken yet
+   */
+  void solve_batch_hands(
+      const Tile *tiles,
+      const size_t *offsets,
+      size_t hand_count,
+      bool *solvable,
+      std::atomic<size_t> &next_hand);
+
+  /**
+   * @brief Recursive function to solve the hand. The tiles are placed in the
+   * order of their bits, which is the hand sorted by denomination then color.
+   *
+   * Copies of a tile are placed one after the other and swapping the actions
+   * of two copies gives the same table, so a copy only tries the actions from
+   * the one used by the previous copy onwards.
+   *
+   * @param remaining The tiles that have not been placed yet
+   * @param last_tile Bit index of the tile placed before this call (-1 if none)
+   * @param last_action Index of the action used for that tile
+   * @param actions The actions to try (VirtualActions or ActionSet)
+   * @return The success of the solve
+   */
+  template<typename Actions>
   bool solver_recurse(
-      size_t current_tile, std::vector<std::unique_ptr<Action>> &actions);
+      PackedHand remaining,
+      int last_tile,
+      size_t last_action,
+      Actions &actions);
+
+  /**
+   * @brief Run the engine on the hand, one connected component at a time
+   * (see connected_tiles) when DECOMPOSE_HAND is on. The hand is playable if
+   * every component is, and its play is the plays of the components. The
+   * filters run first, and the components are solved from the smallest.
+   *
+   * @param store If the play found goes into solution
+   * @return The success of the solve
+   */
+  bool search(bool store);
+
+  /**
+   * @brief Run the engine on the hand, or on the component of it that search
+   * put in hand.
+   *
+   * @param store If the play found goes into solution
+   * @return The success of the solve
+   */
+  bool search_component(bool store);
+
+  /**
+   * @brief Conditions every hand that can be played meets. A tile needs two
+   * neighbours of its color (on one side or around it) or two other colors of
+   * its denomination, which is checked for every tile at once on the masks.
+   * Each copy of a tile needs a set of its own, so for the tiles with copies
+   * the copies cannot outnumber the groups of the denomination plus the runs
+   * the neighbours can make.
+   *
+   * @param hand The hand to check
+   * @return false if the hand can certainly not be played
+   */
+  static bool passes_filters(const PackedHand &hand);
+
+  /**
+   * @brief Check that every set that is not legal yet can still be completed
+   * with the tiles left. The hand is placed in sorted order, so a run can only
+   * grow upwards from its highest tile and a group only with the tiles of its
+   * denomination.
+   *
+   * @param remaining The tiles that have not been placed yet
+   * @return false if some set can never be legal
+   */
+  bool completable(const PackedHand &remaining) const;
+
+  /**
+   * @brief completable() for a hand with jokers: the sets that the tiles left
+   * cannot complete must not need more jokers than the hand has.
+   *
+   * @param remaining The tiles that have not been placed yet
+   * @return false if the jokers are not enough for the sets
+   */
+  bool completable_with_jokers(const PackedHand &remaining) const;
+
+  /**
+   * @brief Store the play of the most tiles or points of the hand. Tiles that
+   * no set of the hand can take are left out first, then every component of
+   * the rest is searched on its own by subset_recurse.
+   *
+   * @return true, the empty play is always legal
+   */
+  bool solve_subset();
+
+  /**
+   * @brief Value of tiles for the objective.
+   *
+   * @param tiles A mask of tiles.
+   * @return Their amount, or the sum of their points.
+   */
+  int subset_value(uint64_t tiles) const;
+
+  /**
+   * @brief An upper bound of the value the tiles left can add to the table:
+   * the value of those that are still in reach of a set, through a window of
+   * 3 denominations of their color or 3 colors of their denomination, among
+   * the tiles left and the tiles that can still grow the sets on the table.
+   *
+   * @param remaining The tiles that have not been placed yet
+   * @return The bound
+   */
+  int subset_bound(const PackedHand &remaining) const;
+
+  /**
+   * @brief Recursive function of solve_subset. It places the tiles in sorted
+   * order like solver_recurse with one more action, leaving the tile in the
+   * hand, and keeps the best legal table it reaches. A state is cut when the
+   * tiles on the table and the bound of the ones left do not beat that table.
+   *
+   * @param remaining The tiles that have not been placed yet
+   * @param last_tile Bit index of the tile placed before this call (-1 if none)
+   * @param last_action Index of the action used for that tile
+   * @param actions The actions to try
+   * @return true to stop the search: the best play is found or time ran out
+   */
+  bool subset_recurse(
+      PackedHand remaining,
+      int last_tile,
+      size_t last_action,
+      ActionSet &actions);
+
+  /**
+   * @brief Solve the hand by sweeping the denominations from 0 to 12. At every
+   * denomination, each color keeps how many runs of 1, 2 and 3+ tiles it has
+   * in progress (at most one per copy of a tile). The tiles that do not
+   * continue or start a run go into the groups of that denomination. The work
+   * done is linear in the amount of denominations.
+   *
+   * @param store If the play found goes into runs and groups
+   * @return The success of the solve
+   */
+  bool solve_dynamic(bool store);
+
+  /**
+   * @brief Solve the hand as a multiset exact cover problem: every legal
+   * classical run and group is enumerated once, and Algorithm X picks sets for
+   * the tile that fits in the least of them until every copy is covered.
+   *
+   * @param store If the play found goes into runs and groups
+   * @return The success of the solve
+   */
+  bool solve_cover(bool store);
 
   /**
-   * @brief Check if a run is legal
+   * @brief Check if a run is legal, every sequence in it must have at least 3
+   * tiles.
    *
    * @param run The run to check
    * @return If the run is valid
    */
-  bool validate_run(std::vector<Tile> &run);
+  static bool validate_run(const Run &run);
 
   /**
    * @brief Check if a group is legal
@@ -176,7 +1376,7 @@ private:
    * @param group The group to check
    * @return If the group is valid
    */
-  bool validate_group(std::vector<Tile> &group);
+  static bool validate_group(const Group &group);
 
   /**
    * @brief Print all runs
@@ -0,0 +1,122 @@
+/**
+ * @file rummikub_batch.cpp
+ * @author Edgar Jose Donoso Mansilla
+ * @course CS280
+ * @term Spring 2025
+ * @assignment# 3
+ */
+
+#include "rummikub.h"
+#include <exception>
+#include <thread>
+
+namespace {
+  // Hands taken from the shared counter at a time. Large enough that the
+  // counter is rarely touched, small enough that a few hard hands do not leave
+  // the other threads idle at the end.
+  const size_t kBatchChunk = 64;
+} // namespace
+
+void RummiKub::SolveBatch(
+    const Tile *tiles,
+    const size_t *offsets,
+    size_t hand_count,
+    bool *solvable,
+    unsigned threads,
+    Engine engine) {
+  if (hand_count == 0) {
+    return;
+  }
+
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+
+  size_t chunks = (hand_count + kBatchChunk - 1) / kBatchChunk;
+  if (threads == 0) {
+    threads = 1;
+  } else if (threads > chunks) {
+    threads = static_cast<unsigned>(chunks);
+  }
+
+  std::atomic<size_t> next_hand{0};
+  // An exception must not leave its thread, it is handed back to the caller
+  std::vector<std::exception_ptr> errors(threads);
+
+  auto work = [&](unsigned worker) {
+    try {
+      RummiKub solver(engine);
+      solver.solve_batch_hands(
+          tiles, offsets, hand_count, solvable, next_hand);
+    } catch (...) {
+      errors[worker] = std::current_exception();
+    }
+  };
+
+  // The calling thread is the first worker
+  std::vector<std::thread> workers;
+  for (unsigned worker = 1; worker < threads; worker++) {
+    workers.emplace_back(work, worker);
+  }
+  work(0);
+
+  for (std::thread &worker: workers) {
+    worker.join();
+  }
+
+  for (const std::exception_ptr &error: errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+void RummiKub::solve_batch_hands(
+    const Tile *tiles,
+    const size_t *offsets,
+    size_t hand_count,
+    bool *solvable,
+    std::atomic<size_t> &next_hand) {
+  // Made once, the actions keep their memory from one hand to the next
+  ActionSet actions(table);
+
+  for (;;) {
+    size_t first = next_hand.fetch_add(kBatchChunk, std::memory_order_relaxed);
+    if (first >= hand_count) {
+      return;
+    }
+
+    size_t last = first + kBatchChunk < hand_count ? first + kBatchChunk
+                                                   : hand_count;
+    for (size_t i = first; i < last; i++) {
+      Reset();
+      for (size_t tile = offsets[i]; tile < offsets[i + 1]; tile++) {
+        Add(tiles[tile]);
+      }
+
+      if (jokers > 0 &&
+          (engine == DynamicProgramming || engine == ExactCover)) {
+        throw "RummiKub: the engine does not play jokers";
+      }
+      if (jokers == 0 && !passes_filters(hand)) {
+        solvable[i] = false;
+        continue;
+      }
+
+      switch (engine) {
+        // The threads of the batch are already busy, and the vtable is only
+        // there to compare single solves with
+        case BruteForce:
+        case ParallelBruteForce:
+        case BruteForceVirtual:
+          solvable[i] = solve_brute_force(actions);
+          break;
+        case BruteForceMostConstrained:
+          solvable[i] = solve_most_constrained(actions);
+          break;
+        case DynamicProgramming: solvable[i] = solve_dynamic(false); break;
+        case ExactCover: solvable[i] = solve_cover(false); break;
+      }
+    }
+  }
+}
@@ -0,0 +1,61 @@
+/**
+ * @file rummikub_bits.h
+ * @author Edgar Jose Donoso Mansilla
+ * @course CS280
+ * @term Spring 2025
+ * @assignment# 3
+ *
+ * The bit tricks over the masks of a PackedHand that the engines share.
+ */
+
+#ifndef RUMMIKUB_BITS_H
+#define RUMMIKUB_BITS_H
+
+#include <cstdint>
+#include "rummikub.h"
+
+/**
+ * @brief Count the bits set in a mask.
+ *
+ * @param mask The mask to count.
+ * @return The amount of bits set.
+ */
+inline int popcount(uint64_t mask) {
+#if defined(__GNUC__)
+  return __builtin_popcountll(mask);
+#else
+  int count = 0;
+  for (; mask != 0; mask &= mask - 1) count++;
+  return count;
+#endif
+}
+
+/**
+ * @brief Count the tiles of a hand.
+ *
+ * @param hand The hand to count.
+ * @return The amount of tiles, with every copy.
+ */
+inline int tile_count(const PackedHand &hand) {
+  int count = 0;
+  for (uint64_t copy: hand.copies) count += popcount(copy);
+  return count;
+}
+
+/**
+ * @brief Index of the lowest bit set in a mask that is not 0.
+ *
+ * @param mask The mask to look in.
+ * @return The index of the bit.
+ */
+inline int lowest_bit(uint64_t mask) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(mask);
+#else
+  int index = 0;
+  for (; !(mask & 1); mask >>= 1) index++;
+  return index;
+#endif
+}
+
+#endif // RUMMIKUB_BITS_H
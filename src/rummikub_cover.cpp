@@ -0,0 +1,239 @@
+/**
+ * @file rummikub_cover.cpp
+ * @author Edgar Jose Donoso Mansilla
+ * @course CS280
+ * @term Spring 2025
+ * @assignment# 3
+ */
+
+#include "rummikub.h"
+#include "rummikub_bits.h"
+#include <cstdint>
+#include <cstring>
+
+namespace {
+  // Any run of 6 or more tiles splits into runs of 3 to 5 tiles, so those are
+  // the only runs needed: 30 per color, and 5 groups per denomination
+  const int kMaxRunLength = 5;
+  const int kRunSets = kColors * ((kDenominations - 2) + (kDenominations - 3) +
+                                  (kDenominations - 4));
+  const int kGroupSets = kDenominations * (kColors + 1);
+  const int kLegalSets = kRunSets + kGroupSets;
+
+  // Most sets a single tile can be part of: 3 + 4 + 5 runs and the 4 groups
+  // of 3 and the group of 4 of its denomination
+  const int kMaxSetsPerTile = 3 + 4 + 5 + kColors + 1;
+
+  const int kTileTypes = kColors * kDenominations;
+
+  /**
+   * @brief Every legal run of up to kMaxRunLength tiles and every group as a
+   * mask of PackedHand bits, with the sets each tile is part of. A longer or
+   * generalized run is a union of these, so they are enough to cover any hand.
+   */
+  struct LegalSets {
+    uint64_t masks[kLegalSets];
+    int set_count;
+
+    int tile_sets[kTileTypes][kMaxSetsPerTile];
+    int tile_set_count[kTileTypes];
+
+    LegalSets() : set_count(0), tile_set_count() {
+      for (int color = 0; color < kColors; color++) {
+        for (int start = 0; start + 3 <= kDenominations; start++) {
+          for (int end = start + 3;
+               end <= kDenominations && end - start <= kMaxRunLength;
+               end++) {
+            uint64_t mask = 0;
+            for (int denomination = start; denomination < end;
+                 denomination++) {
+              mask |= uint64_t{1} << (denomination * kColors + color);
+            }
+            add(mask);
+          }
+        }
+      }
+
+      for (int denomination = 0; denomination < kDenominations;
+           denomination++) {
+        uint64_t all = uint64_t{0xF} << (denomination * kColors);
+        add(all);
+        for (int color = 0; color < kColors; color++) {
+          add(all & ~(uint64_t{1} << (denomination * kColors + color)));
+        }
+      }
+    }
+
+    bool is_run(int set) const { return set < kRunSets; }
+
+  private:
+    void add(uint64_t mask) {
+      int set = set_count++;
+      masks[set] = mask;
+      for (int tile = 0; tile < kTileTypes; tile++) {
+        if (mask & (uint64_t{1} << tile)) {
+          tile_sets[tile][tile_set_count[tile]++] = set;
+        }
+      }
+    }
+  };
+
+  const LegalSets &legal_sets() {
+    static const LegalSets sets;
+    return sets;
+  }
+
+  /**
+   * @brief Take one copy of every tile of a set out of a hand. A tile has more
+   * than i copies left if it had more than i + 1, or more than i and it is not
+   * in the set.
+   *
+   * @param hand The hand (every tile of the set must be in it).
+   * @param set The mask of the set.
+   * @return The hand without the set.
+   */
+  PackedHand subtract(const PackedHand &hand, uint64_t set) {
+    PackedHand rest;
+    for (int copy = 0; copy + 1 < kMaxCopies; copy++) {
+      rest.copies[copy] = hand.copies[copy + 1] | (hand.copies[copy] & ~set);
+    }
+    rest.copies[kMaxCopies - 1] = hand.copies[kMaxCopies - 1] & ~set;
+    return rest;
+  }
+
+  /**
+   * @brief Algorithm X over the multiset of tiles: the columns are the tile
+   * types (with as many copies to cover as the hand has) and the rows are the
+   * legal sets. The same rest of a hand is reached by covering tiles with
+   * different sets, so the rests that failed are kept in a direct mapped cache.
+   */
+  class SetCover {
+  public:
+    static const size_t kCacheSize = 4096;
+
+    /**
+     * @param failed The cache, kCacheSize entries kept across the calls.
+     * @param generation The tag of this call, no entry holds it yet.
+     */
+    SetCover(CoverFailure *failed, uint32_t generation) :
+        chosen(), chosen_count(0), failed(failed), generation(generation) {}
+
+    bool solve(const PackedHand &hand) {
+      if (hand.empty()) return true;
+
+      CoverFailure &entry = failed[slot(hand)];
+      if (entry.generation == generation &&
+          std::memcmp(&entry.hand, &hand, sizeof(PackedHand)) == 0) {
+        return false;
+      }
+      if (solve_column(hand)) return true;
+
+      entry.hand = hand;
+      entry.generation = generation;
+      return false;
+    }
+
+    int set_count() const { return chosen_count; }
+    int set(int index) const { return chosen[index]; }
+
+  private:
+    // A set has at least 3 tiles
+    int chosen[kMaxTiles / 3];
+    int chosen_count;
+
+    CoverFailure *failed;
+    uint32_t generation;
+
+    static size_t slot(const PackedHand &hand) {
+      uint64_t key = hand.copies[0];
+      for (int copy = 1; copy < kMaxCopies; copy++) {
+        key = (key ^ hand.copies[copy]) * 0x9E3779B97F4A7C15ull;
+      }
+      return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 52);
+    }
+
+    bool solve_column(const PackedHand &hand) {
+
+      // Most constrained column among the tiles of the lowest denomination.
+      // Covering the hand from the bottom up keeps the rests that the search
+      // reaches alike, which is what makes the cache hit.
+      const LegalSets &sets = legal_sets();
+      int lowest = lowest_bit(hand.copies[0]) / kColors;
+      uint64_t frontier =
+          hand.copies[0] & (uint64_t{0xF} << (lowest * kColors));
+
+      int best_tile = -1;
+      int best_options = kMaxSetsPerTile + 1;
+      for (uint64_t left = frontier; left != 0; left &= left - 1) {
+        int tile = lowest_bit(left);
+        int options = 0;
+        for (int i = 0; i < sets.tile_set_count[tile]; i++) {
+          uint64_t mask = sets.masks[sets.tile_sets[tile][i]];
+          if ((mask & hand.copies[0]) == mask) options++;
+        }
+
+        if (options == 0) return false;
+        if (options < best_options) {
+          best_tile = tile;
+          best_options = options;
+        }
+      }
+
+      return cover_tile(hand, best_tile, hand.count(best_tile), 0);
+    }
+
+    /**
+     * @brief Pick the sets for every copy of a tile at once, in increasing
+     * order, so that the same sets are not tried again in another order.
+     */
+    bool cover_tile(const PackedHand &hand, int tile, int copies, int from) {
+      if (copies == 0) return solve(hand);
+
+      const LegalSets &sets = legal_sets();
+      for (int i = from; i < sets.tile_set_count[tile]; i++) {
+        int set = sets.tile_sets[tile][i];
+        uint64_t mask = sets.masks[set];
+        if ((mask & hand.copies[0]) != mask) continue;
+
+        chosen[chosen_count++] = set;
+        if (cover_tile(subtract(hand, mask), tile, copies - 1, i)) {
+          return true;
+        }
+        chosen_count--;
+      }
+
+      return false;
+    }
+  };
+} // namespace
+
+bool RummiKub::solve_cover(bool store) {
+  // Entries of the previous calls are told apart by their generation
+  if (cover_failures.empty() || ++cover_generation == 0) {
+    cover_failures.assign(SetCover::kCacheSize, CoverFailure{});
+    cover_generation = 1;
+  }
+
+  SetCover cover(cover_failures.data(), cover_generation);
+  if (!cover.solve(hand)) {
+    return false;
+  }
+
+  if (!store) {
+    return true;
+  }
+
+  const LegalSets &sets = legal_sets();
+  for (int i = 0; i < cover.set_count(); i++) {
+    int set = cover.set(i);
+    int size = popcount(sets.masks[set]);
+
+    Tile *tiles =
+        sets.is_run(set) ? solution.add_run(size) : solution.add_group(size);
+    for (uint64_t mask = sets.masks[set]; mask != 0; mask &= mask - 1) {
+      *tiles++ = PackedHand::tile(lowest_bit(mask));
+    }
+  }
+
+  return true;
+}
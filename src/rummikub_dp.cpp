@@ -0,0 +1,46 @@
+/**
+ * @file rummikub_dp.cpp
+ * @author Edgar Jose Donoso Mansilla
+ * @course CS280
+ * @term Spring 2025
+ * @assignment# 3
+ */
+
+#include "rummikub.h"
+#include "rummikub_bits.h"
+#include "rummikub_sweep.h"
+
+bool RummiKub::solve_dynamic(bool store) {
+  int counts[kDenominations][kColors] = {};
+  for (int denomination = 0; denomination < kDenominations; denomination++) {
+    for (int color = 0; color < kColors; color++) {
+      counts[denomination][color] =
+          hand.count(denomination * kColors + color);
+    }
+  }
+
+  DenominationSweep<StoredRules> sweep(counts);
+  if (!sweep.solve()) {
+    return false;
+  }
+
+  if (!store) {
+    return true;
+  }
+
+  sweep.replay(
+      [this](const SweepRun &run) {
+        Tile *tiles = solution.add_run(run.length);
+        for (int j = 0; j < run.length; j++) {
+          tiles[j] = Tile{run.start + j, static_cast<Color>(run.color)};
+        }
+      },
+      [this](const SweepGroup &group) {
+        Tile *tiles = solution.add_group(popcount(group.colors));
+        for (unsigned left = group.colors; left != 0; left &= left - 1) {
+          *tiles++ = Tile{group.denomination,
+                          static_cast<Color>(lowest_bit(left))};
+        }
+      });
+  return true;
+}
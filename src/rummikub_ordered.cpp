@@ -0,0 +1,133 @@
+/**
+ * @file rummikub_ordered.cpp
+ * @author Edgar Jose Donoso Mansilla
+ * @course CS280
+ * @term Spring 2025
+ * @assignment# 3
+ */
+
+#include "rummikub.h"
+#include "rummikub_bits.h"
+
+namespace {
+  /**
+   * @brief The order of the handout: AddToRun, AddToGroup, CreateRun,
+   * CreateGroup.
+   */
+  void HandoutOrder(const Tile &, uint8_t order[SolverStats::kActions]) {
+    for (int i = 0; i < SolverStats::kActions; i++) {
+      order[i] = static_cast<uint8_t>(i);
+    }
+  }
+} // namespace
+
+void RummiKub::SetActionOrder(ActionOrder order) { action_order = order; }
+
+bool RummiKub::solve_most_constrained(ActionSet &actions) {
+  actions.reset();
+  prepare_brute_force();
+
+  // The transposition keys tell the colors of a denomination apart by the
+  // order they are placed in, which this search changes
+  use_transpositions = false;
+
+  return ordered_recurse(hand, -1, 0, actions);
+}
+
+int RummiKub::viable_actions(
+    const PackedHand &remaining, const Tile &tile, ActionSet &actions) {
+  int count = 0;
+  for (size_t i = 0; i < ActionSet::size(); i++) {
+    if (!actions.execute(i, tile)) continue;
+    if (completable(remaining)) count++;
+    actions.revert(i, tile);
+  }
+  return count;
+}
+
+bool RummiKub::ordered_recurse(
+    PackedHand remaining,
+    int last_tile,
+    size_t last_position,
+    ActionSet &actions) {
+  nodes++;
+
+  int depth = 0;
+  if (collect_stats) {
+    depth = hand_size - tile_count(remaining);
+    stats.depth_nodes[depth]++;
+    if (depth > stats.max_depth) stats.max_depth = depth;
+  }
+
+  if (remaining.empty()) {
+    if (collect_stats) stats.leaves++;
+    return validate_solution();
+  }
+
+  int index = lowest_bit(remaining.copies[0]);
+  if (last_tile >= 0 && ((remaining.copies[0] >> last_tile) & 1)) {
+    // The copies of a tile are placed one after the other, so that a copy can
+    // skip the actions the previous one tried (see solver_recurse)
+    index = last_tile;
+  } else {
+    // Only the tiles of the lowest denomination left keep every run growing
+    // upwards, which completable() relies on
+    uint64_t frontier = remaining.copies[0] &
+                        (uint64_t{0xF} << (index - index % kColors));
+
+    if (frontier & (frontier - 1)) {
+      int fewest = SolverStats::kActions + 1;
+      for (; frontier != 0; frontier &= frontier - 1) {
+        int candidate = lowest_bit(frontier);
+        PackedHand rest = remaining;
+        rest.remove(candidate);
+
+        int count = viable_actions(rest, PackedHand::tile(candidate), actions);
+        if (count < fewest) {
+          fewest = count;
+          index = candidate;
+          // Nothing is more constrained than a single choice
+          if (count <= 1) break;
+        }
+      }
+
+      // A tile that fits nowhere fails the whole state
+      if (fewest == 0) {
+        if (collect_stats) stats.pruned++;
+        return false;
+      }
+    }
+  }
+
+  size_t first_position = index == last_tile ? last_position : 0;
+
+  Tile tile = PackedHand::tile(index);
+  remaining.remove(index);
+
+  uint8_t order[SolverStats::kActions];
+  (action_order != nullptr ? action_order : HandoutOrder)(tile, order);
+
+  for (size_t position = first_position; position < ActionSet::size();
+       position++) {
+    size_t i = order[position];
+    bool success = actions.execute(i, tile);
+    if (collect_stats) (success ? stats.executed : stats.rejected)[i]++;
+    if (!success) continue;
+
+    if (!completable(remaining)) {
+      if (collect_stats) stats.pruned++;
+      actions.revert(i, tile);
+      continue;
+    }
+
+    if (collect_stats) stats.depth_children[depth]++;
+    if (ordered_recurse(remaining, index, position, actions)) {
+      return true;
+    }
+
+    if (collect_stats) stats.backtracks++;
+    actions.revert(i, tile);
+  }
+
+  return false;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file rummikub_parallel.cpp
+ * @author Edgar Jose Donoso Mansilla
+ * @course CS280
+ * @term Spring 2025
+ * @assignment# 3
+ */
+
+#include "rummikub.h"
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+  // Hands that fill less sets than this are solved faster than threads start
+  const int kParallelMinSets = 10;
+
+  // Tasks made for every thread, so that the threads that run out of work
+  // early have something to steal
+  const size_t kTasksPerThread = 16;
+
+  // Tiles placed at most before making the tasks
+  const int kMaxSplitDepth = 12;
+
+  /**
+   * @brief A deque of tasks for every thread. A thread takes its own tasks
+   * from the back and steals the tasks of the others from the front.
+   */
+  template<typename Task>
+  class TaskDeques {
+  public:
+    explicit TaskDeques(unsigned threads) : queues(threads) {}
+
+    void push(unsigned thread, const Task &task) {
+      Queue &queue = queues[thread];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(task);
+    }
+
+    /**
+     * @brief Take a task for a thread, stealing one if it has none left.
+     *
+     * @param thread The thread that takes the task.
+     * @param task Where to write the task.
+     * @return false if every deque is empty.
+     */
+    bool pop(unsigned thread, Task &task) {
+      {
+        Queue &queue = queues[thread];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+          task = queue.tasks.back();
+          queue.tasks.pop_back();
+          return true;
+        }
+      }
+
+      size_t count = queues.size();
+      for (size_t i = 1; i < count; i++) {
+        Queue &queue = queues[(thread + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+          task = queue.tasks.front();
+          queue.tasks.pop_front();
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+  private:
+    struct Queue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    std::vector<Queue> queues;
+  };
+} // namespace
+
+bool RummiKub::solve_parallel() {
+  ActionSet actions(table);
+  prepare_brute_force();
+
+  unsigned threads = thread_count;
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+
+  if (threads <= 1 || table.set_limit < kParallelMinSets) {
+    return solver_recurse(hand, -1, 0, actions);
+  }
+
+  // Going deeper until there are enough subtrees to share
+  std::vector<SearchTask> tasks;
+  for (int depth = 1; depth <= kMaxSplitDepth; depth++) {
+    tasks.clear();
+    split_search(hand, -1, 0, depth, actions, tasks);
+    if (tasks.size() >= threads * kTasksPerThread) break;
+  }
+
+  // Dealt in reverse so that every thread starts with its first task, in the
+  // order the sequential search would get to them
+  TaskDeques<SearchTask> deques(threads);
+  for (size_t i = tasks.size(); i-- > 0;) {
+    deques.push(static_cast<unsigned>(i % threads), tasks[i]);
+  }
+
+  std::atomic<bool> found{false};
+  std::vector<uint64_t> thread_nodes(threads, 0);
+  std::vector<SolverStats> thread_stats(collect_stats ? threads : 0);
+  std::vector<std::vector<TraceSpan>> thread_spans(
+      trace_countdown != 0 ? threads : 0);
+
+  auto work = [&](unsigned thread) {
+    // Every thread has its own table, actions and transposition table
+    RummiKub searcher(BruteForce);
+    searcher.transposition_bytes = transposition_bytes;
+    searcher.hand = hand;
+    searcher.jokers = jokers;
+    searcher.prepare_brute_force();
+    searcher.cancelled = &found;
+    searcher.collect_stats = collect_stats;
+    searcher.trace_interval = trace_interval;
+    searcher.trace_countdown = trace_countdown;
+    searcher.trace_origin = trace_origin;
+    searcher.trace_thread = static_cast<uint16_t>(thread);
+    ActionSet searcher_actions(searcher.table);
+
+    SearchTask task;
+    while (!found.load(std::memory_order_relaxed) &&
+           deques.pop(thread, task)) {
+      searcher.table = task.table;
+      searcher_actions.reset();
+
+      if (searcher.solver_recurse(
+              task.remaining,
+              task.last_tile,
+              task.last_action,
+              searcher_actions)) {
+        // Only the first thread to find a play writes it
+        bool expected = false;
+        if (found.compare_exchange_strong(expected, true)) {
+          table = searcher.table;
+        }
+        break;
+      }
+    }
+
+    thread_nodes[thread] = searcher.nodes;
+    if (collect_stats) {
+      thread_stats[thread] = searcher.stats;
+    }
+    if (trace_countdown != 0) {
+      thread_spans[thread].swap(searcher.trace_spans);
+    }
+  };
+
+  // The calling thread is the first worker
+  std::vector<std::thread> workers;
+  for (unsigned thread = 1; thread < threads; thread++) {
+    workers.emplace_back(work, thread);
+  }
+  work(0);
+
+  for (std::thread &worker: workers) {
+    worker.join();
+  }
+
+  for (uint64_t count: thread_nodes) nodes += count;
+  for (const SolverStats &counts: thread_stats) stats.add(counts);
+  for (const std::vector<TraceSpan> &spans: thread_spans) {
+    trace_spans.insert(trace_spans.end(), spans.begin(), spans.end());
+  }
+
+  return found.load();
+}
@@ -0,0 +1,327 @@
+/**
+ * @file rummikub_sweep.h
+ * @author Edgar Jose Donoso Mansilla
+ * @course CS280
+ * @term Spring 2025
+ * @assignment# 3
+ *
+ * The sweep of the DynamicProgramming engine, templated on the rules so that
+ * every variant gets its own code: the loops over colors have a fixed length
+ * and the state is packed with fields just wide enough for the copies.
+ * IsPlayable and FindPlay solve hands of any variant, RummiKub solves with
+ * StoredRules.
+ */
+
+#ifndef RUMMIKUB_SWEEP_H
+#define RUMMIKUB_SWEEP_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "rummikub.h"
+
+namespace sweep {
+  constexpr int bit_width(int value) {
+    return value == 0 ? 0 : 1 + bit_width(value >> 1);
+  }
+} // namespace sweep
+
+/**
+ * @brief The choice made for one color at one denomination.
+ */
+struct SweepChoice {
+  unsigned char extended; // long runs that got the tile
+  unsigned char started; // new runs started with the tile
+};
+
+/**
+ * @brief A run of a play: length tiles of a color, from start up.
+ */
+struct SweepRun {
+  int color;
+  int start;
+  int length;
+};
+
+/**
+ * @brief A group of a play: one tile of every color of the mask.
+ */
+struct SweepGroup {
+  int denomination;
+  unsigned colors;
+};
+
+/**
+ * @brief Decide if the tiles of a hand can all be played, one denomination at
+ * a time. The state between two denominations is, for every color, how many
+ * runs in progress have 1, 2 and 3 or more tiles. Only runs that got a tile of
+ * the previous denomination are in progress, so there are never more of them
+ * than copies of a tile.
+ *
+ * The only thing remembered per (denomination, state) is whether it already
+ * failed, as the search stops on the first success. This is kept in a direct
+ * mapped cache, a collision only costs solving the state again.
+ *
+ * @tparam R The rules (a Rules<Colors, Denominations, Copies>).
+ */
+template<typename R>
+class DenominationSweep {
+public:
+  typedef int Counts[R::kDenominations][R::kColors];
+
+  explicit DenominationSweep(const Counts &counts) : counts(counts) {
+    std::memset(failed, 0, sizeof(failed));
+    std::memset(path, 0, sizeof(path));
+  }
+
+  bool solve() { return solve_denomination(0, 0); }
+
+  const SweepChoice &choice(int denomination, int color) const {
+    return path[denomination][color];
+  }
+
+  /**
+   * @brief Rebuild the play of a successful solve() from the choices made at
+   * every denomination. A run in progress got a tile at every denomination,
+   * so there are never more of them than copies of a tile.
+   *
+   * @param add_run Called with every SweepRun of the play.
+   * @param add_group Called with every SweepGroup of the play.
+   */
+  template<typename AddRun, typename AddGroup>
+  void replay(AddRun add_run, AddGroup add_group) const {
+    SweepRun slots[R::kColors][R::kCopies];
+    int slot_count[R::kColors] = {};
+
+    for (int denomination = 0; denomination <= R::kDenominations;
+         denomination++) {
+      int grouped[R::kColors] = {};
+
+      for (int color = 0; color < R::kColors; color++) {
+        SweepChoice choice{0, 0};
+        if (denomination < R::kDenominations) {
+          choice = path[denomination][color];
+        }
+
+        // Short runs always continue, only `extended` of the long ones do
+        int long_extended = 0;
+        int kept = 0;
+        for (int i = 0; i < slot_count[color]; i++) {
+          SweepRun &slot = slots[color][i];
+          if (slot.length < 3 || long_extended++ < choice.extended) {
+            slot.length++;
+            slots[color][kept++] = slot;
+          } else {
+            add_run(slot);
+          }
+        }
+
+        for (int i = 0; i < choice.started; i++) {
+          slots[color][kept++] = SweepRun{color, denomination, 1};
+        }
+        slot_count[color] = kept;
+
+        if (denomination < R::kDenominations) {
+          grouped[color] = counts[denomination][color] - kept;
+        }
+      }
+
+      if (denomination == R::kDenominations) break;
+
+      // The tiles are dealt to the groups in turn, color after color: a color
+      // has at most one tile per group, and every group gets 3 tiles or more
+      // as there are at least 3 per group. A tile count is at most the copies,
+      // and so is the amount of groups.
+      int group_total = group_count(grouped);
+      unsigned colors[R::kCopies] = {};
+      int dealt = 0;
+      for (int color = 0; color < R::kColors; color++) {
+        for (int i = 0; i < grouped[color]; i++) {
+          colors[dealt++ % group_total] |= 1u << color;
+        }
+      }
+
+      for (int i = 0; i < group_total; i++) {
+        add_group(SweepGroup{denomination, colors[i]});
+      }
+    }
+  }
+
+  /**
+   * @brief Check if the tiles of one denomination left for groups can be split
+   * into groups. With m groups, each of 3 tiles up to one of every color, the
+   * colors can always be spread so that no group repeats one as long as no
+   * color has more than m tiles.
+   *
+   * @param grouped Amount of tiles of each color that go to groups.
+   * @return The amount of groups needed, or -1 if there is no split.
+   */
+  static int group_count(const int (&grouped)[R::kColors]) {
+    int total = 0;
+    int most = 0;
+    for (int count: grouped) {
+      total += count;
+      if (count > most) most = count;
+    }
+
+    int groups = (total + R::kColors - 1) / R::kColors;
+    if (most > groups) groups = most;
+    return groups * 3 <= total ? groups : -1;
+  }
+
+private:
+  static const int kCacheSize = 2048;
+
+  // Every count in the state of a color fits in a field of this many bits
+  static const int kFieldBits = sweep::bit_width(R::kCopies);
+  static const int kFieldMask = (1 << kFieldBits) - 1;
+  static const int kColorBits = 3 * kFieldBits;
+  static const int kStateBits = R::kColors * kColorBits;
+
+  // The key of the cache is a used bit, the denomination and the state
+  static_assert(
+      1 + sweep::bit_width(R::kDenominations) + kStateBits <= 64,
+      "the state of the rules does not fit in 64 bits");
+
+  /**
+   * @brief The runs in progress for one color.
+   */
+  struct ColorState {
+    int short_runs; // 1 tile
+    int pair_runs; // 2 tiles
+    int long_runs; // 3 or more tiles (these are legal already)
+  };
+
+  static ColorState decode(uint64_t state, int color) {
+    uint64_t fields = state >> (color * kColorBits);
+    return ColorState{
+        static_cast<int>(fields & kFieldMask),
+        static_cast<int>((fields >> kFieldBits) & kFieldMask),
+        static_cast<int>((fields >> (2 * kFieldBits)) & kFieldMask)};
+  }
+
+  static uint64_t encode(const ColorState &runs, int color) {
+    uint64_t fields = static_cast<uint64_t>(runs.short_runs) |
+                      static_cast<uint64_t>(runs.pair_runs) << kFieldBits |
+                      static_cast<uint64_t>(runs.long_runs) << (2 * kFieldBits);
+    return fields << (color * kColorBits);
+  }
+
+  static size_t slot(uint64_t key) {
+    return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 53);
+  }
+
+  const Counts &counts;
+
+  uint64_t failed[kCacheSize];
+  SweepChoice path[R::kDenominations][R::kColors];
+
+  bool solve_denomination(int denomination, uint64_t state) {
+    if (denomination == R::kDenominations) {
+      // Every run left must be legal
+      for (int color = 0; color < R::kColors; color++) {
+        ColorState runs = decode(state, color);
+        if (runs.short_runs > 0 || runs.pair_runs > 0) return false;
+      }
+      return true;
+    }
+
+    // The top bit marks the entry as used
+    uint64_t key = (uint64_t{1} << 63) |
+                   static_cast<uint64_t>(denomination) << kStateBits | state;
+    uint64_t &entry = failed[slot(key)];
+    if (entry == key) return false;
+
+    int grouped[R::kColors] = {};
+    if (solve_color(denomination, 0, state, 0, grouped)) return true;
+
+    entry = key;
+    return false;
+  }
+
+  bool solve_color(
+      int denomination,
+      int color,
+      uint64_t state,
+      uint64_t next_state,
+      int (&grouped)[R::kColors]) {
+    if (color == R::kColors) {
+      if (group_count(grouped) < 0) return false;
+      return solve_denomination(denomination + 1, next_state);
+    }
+
+    ColorState runs = decode(state, color);
+    int available = counts[denomination][color];
+
+    // Runs with less than 3 tiles have to continue
+    int left = available - runs.short_runs - runs.pair_runs;
+    if (left < 0) return false;
+
+    // Preferring to extend and start runs over putting tiles into groups
+    for (int extended = runs.long_runs < left ? runs.long_runs : left;
+         extended >= 0;
+         extended--) {
+      for (int started = left - extended; started >= 0; started--) {
+        ColorState next{started, runs.short_runs, runs.pair_runs + extended};
+
+        path[denomination][color] = SweepChoice{
+            static_cast<unsigned char>(extended),
+            static_cast<unsigned char>(started)};
+        grouped[color] = left - extended - started;
+        if (solve_color(
+                denomination,
+                color + 1,
+                state,
+                next_state | encode(next, color),
+                grouped)) {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+};
+
+/**
+ * @brief Check if a hand of a variant of the rules can be played whole.
+ *
+ * @tparam R The rules (a Rules<Colors, Denominations, Copies>).
+ * @param counts The copies of every tile in the hand, at most R::kCopies.
+ * @return If the hand can be split into legal runs and groups.
+ */
+template<typename R>
+bool IsPlayable(const int (&counts)[R::kDenominations][R::kColors]) {
+  DenominationSweep<R> sweep(counts);
+  return sweep.solve();
+}
+
+/**
+ * @brief Find a play of a hand of a variant of the rules.
+ *
+ * @tparam R The rules (a Rules<Colors, Denominations, Copies>).
+ * @param counts The copies of every tile in the hand, at most R::kCopies.
+ * @param runs Where to write the runs of the play (emptied first).
+ * @param groups Where to write the groups of the play (emptied first).
+ * @return If the hand can be split into legal runs and groups.
+ */
+template<typename R>
+bool FindPlay(
+    const int (&counts)[R::kDenominations][R::kColors],
+    std::vector<SweepRun> &runs,
+    std::vector<SweepGroup> &groups) {
+  runs.clear();
+  groups.clear();
+
+  DenominationSweep<R> sweep(counts);
+  if (!sweep.solve()) {
+    return false;
+  }
+
+  sweep.replay(
+      [&](const SweepRun &run) { runs.push_back(run); },
+      [&](const SweepGroup &group) { groups.push_back(group); });
+  return true;
+}
+
+#endif
@@ -0,0 +1,151 @@
+/**
+ * @file trace_folded.cpp
+ * @author Edgar Jose Donoso Mansilla
+ * @course CS280
+ * @term Spring 2025
+ * @assignment# 3
+ *
+ * Turns a trace written by RummiKub::SetTrace() into folded stacks, the input
+ * of flamegraph.pl and speedscope. Usage:
+ *   trace_folded [trace.json] > search.folded
+ * The trace is read from stdin when no file is given. Every line of the output
+ * is a chain of sampled spans, outermost first, followed by the nanoseconds
+ * spent in the last one and not in a sampled span inside it. A frame is the
+ * depth of the span and its action, such as "12 CreateRun".
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+  struct Span {
+    std::string frame;
+    double start;
+    double duration;
+    long thread;
+  };
+
+  /**
+   * @brief Find the value of a field in a line of the trace.
+   *
+   * @param line The line to look in.
+   * @param key The name of the field, with its quotes and colon.
+   * @return Where the value starts, nullptr if the field is not there.
+   */
+  const char *Field(const std::string &line, const char *key) {
+    std::string::size_type at = line.find(key);
+    if (at == std::string::npos) return nullptr;
+    return line.c_str() + at + std::strlen(key);
+  }
+
+  /**
+   * @brief Read a span from a line of the trace.
+   *
+   * @param line The line to read.
+   * @param span Where to write the span.
+   * @return false if the line is not a complete span.
+   */
+  bool ParseSpan(const std::string &line, Span &span) {
+    const char *name = Field(line, "\"name\":\"");
+    const char *start = Field(line, "\"ts\":");
+    const char *duration = Field(line, "\"dur\":");
+    const char *thread = Field(line, "\"tid\":");
+    const char *depth = Field(line, "\"depth\":");
+    if (!name || !start || !duration || !thread || !depth) return false;
+
+    const char *name_end = std::strchr(name, '"');
+    if (name_end == nullptr) return false;
+
+    span.frame = std::to_string(std::strtol(depth, nullptr, 10)) + " " +
+                 std::string(name, name_end);
+    span.start = std::strtod(start, nullptr);
+    span.duration = std::strtod(duration, nullptr);
+    span.thread = std::strtol(thread, nullptr, 10);
+    return true;
+  }
+
+  /**
+   * @brief Add the time of every chain of spans to the stacks. Spans nest in
+   * time, so a span is inside the last one that is still open when it starts.
+   *
+   * @param spans The spans, sorted by thread and start.
+   * @param stacks The nanoseconds of every chain.
+   */
+  void Fold(
+      const std::vector<Span> &spans, std::map<std::string, double> &stacks) {
+    // The chain of open spans, with the time left to them after the spans
+    // inside them
+    std::vector<const Span *> open;
+    std::vector<double> self;
+
+    auto close = [&]() {
+      std::string chain;
+      for (const Span *span: open) {
+        if (!chain.empty()) chain += ";";
+        chain += span->frame;
+      }
+      stacks[chain] += self.back() * 1000;
+      open.pop_back();
+      self.pop_back();
+    };
+
+    for (size_t i = 0; i < spans.size(); i++) {
+      const Span &span = spans[i];
+      if (i > 0 && span.thread != spans[i - 1].thread) {
+        while (!open.empty()) close();
+      }
+      while (!open.empty() &&
+             span.start >= open.back()->start + open.back()->duration) {
+        close();
+      }
+
+      if (!self.empty()) self.back() -= span.duration;
+      open.push_back(&span);
+      self.push_back(span.duration);
+    }
+    while (!open.empty()) close();
+  }
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::ifstream file;
+  if (argc > 1) {
+    file.open(argv[1]);
+    if (!file) {
+      std::cerr << "trace_folded: cannot open " << argv[1] << std::endl;
+      return 1;
+    }
+  }
+  std::istream &in = argc > 1 ? file : std::cin;
+
+  std::vector<Span> spans;
+  std::string line;
+  Span span;
+  while (std::getline(in, line)) {
+    if (ParseSpan(line, span)) spans.push_back(span);
+  }
+
+  // Outer spans first when two start at the same time
+  std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b) {
+    if (a.thread != b.thread) return a.thread < b.thread;
+    if (a.start != b.start) return a.start < b.start;
+    return a.duration > b.duration;
+  });
+
+  std::map<std::string, double> stacks;
+  Fold(spans, stacks);
+
+  for (const std::pair<const std::string, double> &stack: stacks) {
+    long nanoseconds = std::lround(stack.second);
+    if (nanoseconds > 0) std::cout << stack.first << " " << nanoseconds << "\n";
+  }
+
+  return 0;
+}